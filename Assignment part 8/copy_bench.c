@@ -0,0 +1,157 @@
+#define _XOPEN_SOURCE 700	// to use nftw
+#define _DEFAULT_SOURCE		// to use mkdtemp
+#include <ftw.h>		// to use nftw, FTW_DEPTH, FTW_PHYS
+#include <fcntl.h>		// to use open, O_*
+#include <sys/stat.h>		// to use mkdir
+#include <unistd.h>		// to use write, close, sync
+#include <stdlib.h>		// to use mkdtemp
+#include <string.h>		// to use strcmp, memset
+#include <stdio.h>		// to use printf, snprintf, perror, remove
+#include <time.h>		// to use clock_gettime
+
+#include "copy_bench.h"
+#include "copy_tree.h"		// to use tree_copy_start, tree_copy_add, tree_copy_finish
+#include "copy_sync.h"		// to use sync_fs
+
+#define BENCH_PER_DIR 100	// files per generated directory
+#define BENCH_ROUNDS  3		// every variant runs this many times, the best run counts
+#define BENCH_MAX_SIZE (16 * 1024)
+#define BENCH_VARIANTS 4
+
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int remove_entry(const char* path, const struct stat* st, int type, struct FTW* ftw) {
+	(void)st; (void)type; (void)ftw;
+	remove(path);
+	return 0;
+}
+
+static void remove_tree(const char* path) {
+	nftw(path, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+}
+
+// <base>/src/dNNN/fNNN, sizes spread between 1 byte and BENCH_MAX_SIZE like a source tree
+static int make_tree(const char* base, int num_files) {
+	char buf[BENCH_MAX_SIZE];
+	memset(buf, 'x', sizeof(buf));
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/src", base);
+	if (mkdir(path, 0755) < 0) {
+		perror("Error in creating the benchmark tree");
+		return OPEN_ERROR;
+	}
+	for (int i = 0; i < num_files; i++) {
+		if (i % BENCH_PER_DIR == 0) {
+			snprintf(path, sizeof(path), "%s/src/d%03d", base, i / BENCH_PER_DIR);
+			if (mkdir(path, 0755) < 0) {
+				perror("Error in creating the benchmark tree");
+				return OPEN_ERROR;
+			}
+		}
+		snprintf(path, sizeof(path), "%s/src/d%03d/f%03d", base, i / BENCH_PER_DIR, i % BENCH_PER_DIR);
+		int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) {
+			perror("Error in creating the benchmark tree");
+			return OPEN_ERROR;
+		}
+		size_t size = 1 + (i * 2654435761u) % BENCH_MAX_SIZE;
+		if (write(fd, buf, size) != (ssize_t)size) {
+			perror("Error in creating the benchmark tree");
+			close(fd);
+			return WRITE_ERROR;
+		}
+		close(fd);
+	}
+	return 0;
+}
+
+// copy <base>/src to <base>/dest once, the destination is removed first
+static int run_copy(const char* prog, const char* base, const struct copy_options* opts, double* seconds, struct tree_totals* totals) {
+	char src[4096];
+	char dest[4096];
+	snprintf(src, sizeof(src), "%s/src", base);
+	snprintf(dest, sizeof(dest), "%s/dest", base);
+	remove_tree(dest);
+	sync(); // the writeback of the previous run shouldn't land in this one
+
+	double start = now_seconds();
+	struct tree_copy* tc = tree_copy_start(prog, opts);
+	if (tc == NULL) {
+		return THREAD_ERROR;
+	}
+	tree_copy_add(tc, src, AT_FDCWD, "", dest);
+	int ret = tree_copy_finish(tc, totals);
+	if (ret == 0 && opts->sync == SYNC_FS) {
+		ret = sync_fs(dest, &totals->stats);
+	}
+	*seconds = now_seconds() - start;
+	return ret;
+}
+
+
+int copy_bench(const char* prog, const char* what, int num_files, const struct copy_options* opts) {
+	struct copy_options variants[BENCH_VARIANTS];
+	const char* names[BENCH_VARIANTS];
+	int num_variants = 0;
+	if (strcmp(what, "uring") == 0) {
+		variants[0] = *opts;
+		variants[0].engine = ENGINE_SYNC;
+		names[0] = "sync";
+		variants[1] = *opts;
+		variants[1].engine = ENGINE_URING;
+		names[1] = "io_uring";
+		num_variants = 2;
+	}
+	else if (strcmp(what, "sync") == 0) {
+		const char* policies[BENCH_VARIANTS] = {"none", "file", "batch", "fs"};
+		for (int v = 0; v < BENCH_VARIANTS; v++) {
+			variants[v] = *opts;
+			variants[v].sync = SYNC_NONE + v;
+			names[v] = policies[v];
+		}
+		num_variants = BENCH_VARIANTS;
+	}
+	else {
+		fprintf(stderr, "%s: unknown benchmark '%s'\n", prog, what);
+		return ARGUMENT_ERROR;
+	}
+	for (int v = 0; v < num_variants; v++) {
+		variants[v].recursive = 1;
+		variants[v].verbose = 0;
+	}
+
+	char base[] = "cp-bench.XXXXXX";
+	if (mkdtemp(base) == NULL) {
+		perror("Error in creating the benchmark directory");
+		return OPEN_ERROR;
+	}
+	int ret = make_tree(base, num_files);
+
+	double best[BENCH_VARIANTS] = {0};
+	struct tree_totals totals[BENCH_VARIANTS];
+	for (int round = 0; round < BENCH_ROUNDS && ret == 0; round++) {
+		for (int v = 0; v < num_variants && ret == 0; v++) {
+			double seconds = 0;
+			ret = run_copy(prog, base, &variants[v], &seconds, &totals[v]);
+			if (round == 0 || seconds < best[v]) {
+				best[v] = seconds;
+			}
+		}
+	}
+
+	if (ret == 0) {
+		printf("%s: %d files, best of %d runs\n", prog, num_files, BENCH_ROUNDS);
+		// the last column compares every variant with the first one
+		for (int v = 0; v < num_variants; v++) {
+			printf("  %-10s %8.3f s %10.0f files/s %10llu calls (%s) %6.2fx\n", names[v], best[v],
+				num_files / best[v], totals[v].stats.calls, copy_strategy_name(totals[v].stats.strategy), best[0] / best[v]);
+		}
+	}
+	remove_tree(base);
+	return ret;
+}
@@ -0,0 +1,15 @@
+#ifndef COPY_BENCH_H
+#define COPY_BENCH_H
+
+#include "copy_engine.h"	// to use struct copy_options
+
+#define BENCH_FILES 10000	// files generated when --bench-files isn't given
+
+// cp --bench=WHAT: build a scratch tree of num_files small files in the working directory,
+// copy it with each variant of WHAT and print the time and the syscalls of every variant
+// "uring" compares the sync and the io_uring engines of the tree copy,
+// "sync" the --sync policies none, file, batch and fs
+// returns 0 or a negative error code, the scratch tree is removed in any case
+int copy_bench(const char* prog, const char* what, int num_files, const struct copy_options* opts);
+
+#endif
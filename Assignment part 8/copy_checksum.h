@@ -0,0 +1,15 @@
+#ifndef COPY_CHECKSUM_H
+#define COPY_CHECKSUM_H
+
+#include <stddef.h>	// to use size_t
+#include <sys/types.h>	// to use off_t
+
+// CRC32C (Castagnoli, the iSCSI/ext4/btrfs polynomial) of buf, continuing from crc,
+// the value returned for the data before it (0 to start), so a stream can be hashed in parts
+// uses the SSE4.2 crc32 instruction when the CPU has it and a table otherwise
+unsigned int crc32c(unsigned int crc, const void* buf, size_t len);
+
+// crc32c of len zero bytes, for the holes a sparse copy skips
+unsigned int crc32c_zeros(unsigned int crc, off_t len);
+
+#endif
@@ -0,0 +1,241 @@
+#define _GNU_SOURCE		// to use pread, pwrite, posix_memalign, posix_fadvise, ftruncate
+#include <pthread.h>		// to use pthread_create, pthread_join
+#include <unistd.h>		// to use pread, pwrite, lseek, ftruncate, sysconf
+#include <fcntl.h>		// to use posix_fadvise
+#include <sys/stat.h>		// to use fstat
+#include <stdlib.h>		// to use posix_memalign, free
+#include <string.h>		// to use memcmp
+#include <stdio.h>		// to use perror
+#include <errno.h>		// to use errno
+
+#include "copy_engine.h"
+
+#define MAX_THREADS 64
+#define DELTA_UNIT  (8 * 1024 * 1024)	// bytes a thread reads from both files per step
+#define DELTA_BLOCK (128 * 1024)	// granularity of the comparison, only differing blocks are written
+
+// shared by the threads comparing one pair of files, like the chunks of copy_fd_parallel
+struct delta_job {
+	int fd_src;
+	int fd_dest;
+	off_t src_base;
+	off_t dest_base;
+	off_t size;		// bytes to produce in the destination
+	off_t dest_size;	// bytes the destination already had past dest_base
+	long num_units;
+	long next_unit;		// taken with __atomic_fetch_add
+	int error;		// first error, makes the other threads stop
+	int error_errno;
+};
+
+struct delta_worker {
+	pthread_t thread;
+	struct delta_job* job;
+	struct copy_stats stats;
+};
+
+
+static int is_zero(const char* buf, size_t len) {
+	return len == 0 || (buf[0] == 0 && memcmp(buf, buf + 1, len - 1) == 0);
+}
+
+static int read_full(int fd, char* buf, size_t len, off_t offset, struct copy_stats* stats, size_t* done) {
+	*done = 0;
+	while (*done < len) {
+		ssize_t num_bytes_read = pread(fd, buf + *done, len - *done, offset + *done);
+		if (num_bytes_read < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return READ_ERROR;
+		}
+		copy_count_call(stats, CALL_PREAD);
+		if (num_bytes_read == 0) {
+			break;
+		}
+		*done += num_bytes_read;
+	}
+	return 0;
+}
+
+static int write_full(int fd, const char* buf, size_t len, off_t offset, struct copy_stats* stats) {
+	for (size_t done = 0; done < len; ) {
+		unsigned long long start = copy_now_ns();
+		ssize_t num_bytes_written = pwrite(fd, buf + done, len - done, offset + done);
+		if (num_bytes_written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return WRITE_ERROR;
+		}
+		copy_count_write(stats, CALL_PWRITE, start);
+		done += num_bytes_written;
+	}
+	return 0;
+}
+
+// compare one unit block by block and write the runs of blocks that differ with one pwrite each
+static int delta_unit(struct delta_job* job, off_t offset, char* src_buf, char* dest_buf, struct copy_stats* stats) {
+	size_t len = job->size - offset < DELTA_UNIT ? job->size - offset : DELTA_UNIT;
+	size_t src_len;
+	if (read_full(job->fd_src, src_buf, len, job->src_base + offset, stats, &src_len) < 0) {
+		return READ_ERROR;
+	}
+	// past the old end there is nothing to compare with
+	size_t dest_len = 0;
+	if (offset < job->dest_size) {
+		size_t want = job->dest_size - offset < (off_t)src_len ? (size_t)(job->dest_size - offset) : src_len;
+		if (read_full(job->fd_dest, dest_buf, want, job->dest_base + offset, stats, &dest_len) < 0) {
+			return READ_ERROR;
+		}
+	}
+
+	size_t run_start = 0;
+	size_t run_len = 0;
+	for (size_t pos = 0; pos < src_len; pos += DELTA_BLOCK) {
+		size_t block = src_len - pos < DELTA_BLOCK ? src_len - pos : DELTA_BLOCK;
+		int same;
+		if (pos + block <= dest_len) {
+			same = memcmp(src_buf + pos, dest_buf + pos, block) == 0;
+		}
+		else {
+			// zeros past the old end become a hole when the file is extended at the end
+			same = pos >= dest_len && is_zero(src_buf + pos, block);
+		}
+
+		if (same) {
+			// past the old end nothing was reused, the block is only left as a hole
+			if (pos >= dest_len) {
+				stats->hole_bytes += block;
+			}
+			else {
+				stats->skipped_bytes += block;
+			}
+			if (run_len > 0 && write_full(job->fd_dest, src_buf + run_start, run_len, job->dest_base + offset + run_start, stats) < 0) {
+				return WRITE_ERROR;
+			}
+			run_len = 0;
+		}
+		else {
+			if (run_len == 0) {
+				run_start = pos;
+			}
+			run_len += block;
+		}
+	}
+	if (run_len > 0 && write_full(job->fd_dest, src_buf + run_start, run_len, job->dest_base + offset + run_start, stats) < 0) {
+		return WRITE_ERROR;
+	}
+	stats->bytes += src_len;
+	return 0;
+}
+
+static void* delta_worker_run(void* arg) {
+	struct delta_worker* worker = arg;
+	struct delta_job* job = worker->job;
+	char* bufs;
+	int ret = 0;
+	// a file smaller than a unit (most of a tree) only needs room for itself
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t half = (size_t)job->size < DELTA_UNIT ? ((size_t)job->size + page - 1) / page * page : DELTA_UNIT;
+	if (half == 0) {
+		half = page;
+	}
+	if (posix_memalign((void**)&bufs, page, 2 * half) != 0) {
+		ret = MALLOC_ERROR;
+		bufs = NULL;
+	}
+
+	while (ret == 0 && __atomic_load_n(&job->error, __ATOMIC_RELAXED) == 0) {
+		long unit = __atomic_fetch_add(&job->next_unit, 1, __ATOMIC_RELAXED);
+		if (unit >= job->num_units) {
+			break;
+		}
+		ret = delta_unit(job, (off_t)unit * DELTA_UNIT, bufs, bufs + half, &worker->stats);
+	}
+	if (ret < 0) {
+		int err = errno;
+		int no_error = 0;
+		if (__atomic_compare_exchange_n(&job->error, &no_error, ret, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			job->error_errno = err;
+		}
+	}
+	free(bufs);
+	return NULL;
+}
+
+
+int copy_fd_delta(int fd_src, int fd_dest, const struct copy_options* opts, struct copy_stats* stats) {
+	struct stat st_src, st_dest;
+	if (fstat(fd_src, &st_src) < 0 || fstat(fd_dest, &st_dest) < 0 || !S_ISREG(st_src.st_mode) || !S_ISREG(st_dest.st_mode)) {
+		return NOT_SUPPORTED;
+	}
+	struct delta_job job = {0};
+	job.fd_src = fd_src;
+	job.fd_dest = fd_dest;
+	job.src_base = lseek(fd_src, 0, SEEK_CUR);
+	job.dest_base = lseek(fd_dest, 0, SEEK_CUR);
+	if (job.src_base < 0 || job.dest_base < 0) {
+		return NOT_SUPPORTED;
+	}
+	job.size = st_src.st_size > job.src_base ? st_src.st_size - job.src_base : 0;
+	job.dest_size = st_dest.st_size > job.dest_base ? st_dest.st_size - job.dest_base : 0;
+	job.num_units = (job.size + DELTA_UNIT - 1) / DELTA_UNIT;
+	posix_fadvise(fd_src, job.src_base, job.size, POSIX_FADV_SEQUENTIAL);
+	posix_fadvise(fd_dest, job.dest_base, job.dest_size, POSIX_FADV_SEQUENTIAL);
+
+	int num_threads = opts->threads > 0 ? opts->threads : sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_threads > MAX_THREADS) {
+		num_threads = MAX_THREADS;
+	}
+	if (num_threads > job.num_units) {
+		num_threads = job.num_units;
+	}
+	if (num_threads < 1) {
+		num_threads = 1;
+	}
+
+	struct delta_worker workers[MAX_THREADS] = {0};
+	int started = 0;
+	for (int i = 0; i < num_threads && job.num_units > 1; i++) {
+		workers[i].job = &job;
+		if (pthread_create(&workers[i].thread, NULL, delta_worker_run, &workers[i]) != 0) {
+			break;
+		}
+		started++;
+	}
+	if (started == 0) {
+		// a single unit or no thread at all, this one does the work
+		workers[0].job = &job;
+		delta_worker_run(&workers[0]);
+	}
+	for (int i = 0; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+
+	stats->strategy = COPY_DELTA;
+	stats->threads = started > 0 ? started : 1;
+	stats->checksummed = 0; // the units are compared in any order
+	for (int i = 0; i < stats->threads; i++) {
+		copy_stats_add(stats, &workers[i].stats);
+	}
+	if (job.error < 0) {
+		errno = job.error_errno;
+		perror("Error in updating destination file");
+		return job.error;
+	}
+
+	// cut what the old destination had past the new end, or extend it over a trailing run of zeros
+	if (job.dest_size != job.size) {
+		if (ftruncate(fd_dest, job.dest_base + job.size) < 0) {
+			perror("Error in setting the size of destination file");
+			return TRUNCATE_ERROR;
+		}
+		copy_count_call(stats, CALL_TRUNCATE);
+	}
+	if (lseek(fd_src, job.src_base + job.size, SEEK_SET) < 0 || lseek(fd_dest, job.dest_base + job.size, SEEK_SET) < 0) {
+		perror("Error in seeking to the end of the copy");
+		return SEEK_ERROR;
+	}
+	return 0;
+}
@@ -0,0 +1,175 @@
+#define _GNU_SOURCE		// to use O_DIRECT, statx
+#include <pthread.h>		// to use pthread_mutex_*
+#include <unistd.h>		// to use read, write, lseek, sysconf
+#include <fcntl.h>		// to use fcntl, O_DIRECT, AT_EMPTY_PATH
+#include <sys/stat.h>		// to use statx
+#include <stdlib.h>		// to use posix_memalign, free
+#include <stdio.h>		// to use perror
+#include <errno.h>		// to use errno
+
+#include "copy_engine.h"
+#include "copy_checksum.h"	// to use crc32c
+
+#define DIRECT_BUF     (4 * 1024 * 1024)
+#define DIRECT_ALIGN   4096		// used when the file system doesn't tell its alignment
+#define POOL_SIZE      64		// buffers kept for reuse (one per concurrent copy)
+
+// aligned buffers are expensive to get (mmap), so the copies of a tree share a pool of them
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static char* pool[POOL_SIZE];
+static int pool_count;
+static size_t pool_align;	// alignment of the buffers in the pool
+
+
+static char* get_buffer(size_t align) {
+	char* buf = NULL;
+	pthread_mutex_lock(&pool_lock);
+	if (pool_count > 0 && pool_align >= align) {
+		buf = pool[--pool_count];
+	}
+	pthread_mutex_unlock(&pool_lock);
+	if (buf == NULL && posix_memalign((void**)&buf, align, DIRECT_BUF) != 0) {
+		return NULL;
+	}
+	return buf;
+}
+
+static void put_buffer(char* buf, size_t align) {
+	pthread_mutex_lock(&pool_lock);
+	if (pool_count == 0) {
+		pool_align = align;
+	}
+	if (pool_count < POOL_SIZE && align == pool_align) {
+		pool[pool_count++] = buf;
+		buf = NULL;
+	}
+	pthread_mutex_unlock(&pool_lock);
+	free(buf);
+}
+
+// the stricter of the memory and offset alignments O_DIRECT needs for this file
+static size_t direct_alignment(int fd) {
+	struct statx sx;
+	if (statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &sx) == 0 && (sx.stx_mask & STATX_DIOALIGN)
+		&& sx.stx_dio_offset_align > 0) {
+		size_t align = sx.stx_dio_offset_align;
+		if (sx.stx_dio_mem_align > align) {
+			align = sx.stx_dio_mem_align;
+		}
+		return align;
+	}
+	return DIRECT_ALIGN;
+}
+
+static int set_direct(int fd, int flags, int on) {
+	return fcntl(fd, F_SETFL, on ? (flags | O_DIRECT) : (flags & ~O_DIRECT));
+}
+
+
+int copy_fd_direct(int fd_src, int fd_dest, struct copy_stats* stats) {
+	size_t align = direct_alignment(fd_src);
+	if (direct_alignment(fd_dest) > align) {
+		align = direct_alignment(fd_dest);
+	}
+	if (align < (size_t)sysconf(_SC_PAGESIZE)) {
+		align = sysconf(_SC_PAGESIZE);
+	}
+
+	// O_DIRECT only works from aligned offsets
+	off_t src_base = lseek(fd_src, 0, SEEK_CUR);
+	off_t dest_base = lseek(fd_dest, 0, SEEK_CUR);
+	if (src_base < 0 || dest_base < 0 || src_base % align != 0 || dest_base % align != 0) {
+		return NOT_SUPPORTED;
+	}
+
+	int src_flags = fcntl(fd_src, F_GETFL);
+	int dest_flags = fcntl(fd_dest, F_GETFL);
+	if (src_flags < 0 || dest_flags < 0) {
+		return NOT_SUPPORTED;
+	}
+	// file systems without direct I/O refuse the flag
+	if (set_direct(fd_src, src_flags, 1) < 0) {
+		return NOT_SUPPORTED;
+	}
+	if (set_direct(fd_dest, dest_flags, 1) < 0) {
+		set_direct(fd_src, src_flags, 0);
+		return NOT_SUPPORTED;
+	}
+
+	char* buf = get_buffer(align);
+	if (buf == NULL) {
+		perror("Unable to allocate the direct I/O buffer");
+		set_direct(fd_src, src_flags, 0);
+		set_direct(fd_dest, dest_flags, 0);
+		return MALLOC_ERROR;
+	}
+
+	int ret = 0;
+	int src_direct = 1;
+	int dest_direct = 1;
+	while (1) {
+		ssize_t num_bytes_read = read(fd_src, buf, DIRECT_BUF);
+		if (num_bytes_read < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("Error in reading from source file");
+			ret = READ_ERROR;
+			break;
+		}
+		copy_count_call(stats, CALL_READ);
+		if (num_bytes_read == 0) {
+			break;
+		}
+		if (stats->checksummed) {
+			stats->checksum = crc32c(stats->checksum, buf, num_bytes_read);
+		}
+
+		// whole blocks go straight to the device, the unaligned tail (the end of the file)
+		// goes through the page cache since O_DIRECT can't write a partial block
+		size_t aligned = num_bytes_read - num_bytes_read % align;
+		size_t done = 0;
+		while (done < (size_t)num_bytes_read) {
+			if (done == aligned && dest_direct) {
+				set_direct(fd_dest, dest_flags, 0);
+				dest_direct = 0;
+			}
+			size_t count = (done < aligned ? aligned : (size_t)num_bytes_read) - done;
+			unsigned long long start = copy_now_ns();
+			ssize_t num_bytes_written = write(fd_dest, buf + done, count);
+			if (num_bytes_written < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				if (errno == EINVAL && dest_direct) {
+					// a short write left done unaligned, or the file system took O_DIRECT
+					// in F_SETFL but not the I/O: the rest goes through the page cache
+					set_direct(fd_dest, dest_flags, 0);
+					dest_direct = 0;
+					continue;
+				}
+				perror("Error in writing to destination file");
+				ret = WRITE_ERROR;
+				break;
+			}
+			copy_count_write(stats, CALL_WRITE, start);
+			done += num_bytes_written;
+		}
+		if (ret < 0) {
+			break;
+		}
+		stats->bytes += num_bytes_read;
+
+		// a short read leaves the source offset unaligned, finish without O_DIRECT
+		if (aligned != (size_t)num_bytes_read && src_direct) {
+			set_direct(fd_src, src_flags, 0);
+			src_direct = 0;
+		}
+	}
+
+	put_buffer(buf, align);
+	fcntl(fd_src, F_SETFL, src_flags);
+	fcntl(fd_dest, F_SETFL, dest_flags);
+	stats->strategy = COPY_DIRECT;
+	return ret;
+}
@@ -0,0 +1,731 @@
+#define _GNU_SOURCE		// to use copy_file_range, splice, pipe2, F_SETPIPE_SZ, sync_file_range
+#include <unistd.h>		// to use read, write, close, lseek, ftruncate, sysconf, copy_file_range
+#include <fcntl.h>		// to use splice, pipe2, fcntl, posix_fadvise, sync_file_range
+#include <errno.h>		// to use errno
+#include <stdio.h>		// to use perror, fprintf
+#include <stdlib.h>		// to use posix_memalign, free
+#include <string.h>		// to use memcmp, memset
+#include <sys/sendfile.h>	// to use sendfile
+#include <sys/stat.h>		// to use fstat
+#include <sys/ioctl.h>		// to use ioctl
+#include <linux/fs.h>		// to use FICLONE, FICLONERANGE
+#include <time.h>		// to use clock_gettime
+
+#include "copy_engine.h"
+#include "copy_checksum.h"	// to use crc32c, crc32c_zeros
+
+#define DRAIN_COUNT    16384
+#define KERNEL_CHUNK   (1 << 30)		// bytes asked per kernel-side call (the kernel caps it below 2 GiB anyway)
+#define PIPE_SIZE      (1 << 20)		// capacity requested for the splice pipe
+#define STREAM_MIN_BUF (128 * 1024)
+#define STREAM_MAX_BUF (8 * 1024 * 1024)
+#define DROP_WINDOW    (8 * 1024 * 1024)	// bytes copied between two page cache drops
+
+// the strategy functions below copy until the source is exhausted or *left bytes
+// were copied (*left < 0 means no limit, it is decreased as data moves) and return
+//	 0 when done
+//	 NOT_SUPPORTED when the strategy isn't supported for these descriptors, nothing is lost
+//	   because all of them use (and advance) the file offsets, so the next one continues from there
+//	<0 on error
+
+
+// errno values telling that the kernel can't do this kind of copy for these descriptors
+static int is_unsupported(int err) {
+	return err == ENOSYS || err == EXDEV || err == EINVAL || err == EOPNOTSUPP || err == EBADF;
+}
+
+// copy_file_range and sendfile return 0 right away for some pseudo files (procfs, sysfs)
+// that have data, only trust that 0 if the source is a regular file that is really empty
+static int is_really_empty(int fd) {
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		return 0;
+	}
+	return S_ISREG(st.st_mode) && st.st_size == 0;
+}
+
+// how much to ask for in the next call: a full chunk or what's left of a bounded copy
+static size_t next_count(off_t left, size_t chunk) {
+	return (left >= 0 && left < (off_t)chunk) ? (size_t)left : chunk;
+}
+
+static void account(struct copy_stats* stats, enum copy_strategy strategy, ssize_t num_bytes, off_t* left) {
+	stats->strategy = strategy;
+	if (strategy != COPY_READ_WRITE) {
+		stats->checksummed = 0; // the data never came through a buffer of ours
+	}
+	stats->bytes += num_bytes;
+	if (*left >= 0) {
+		*left -= num_bytes;
+	}
+}
+
+static int write_all(int fd, const char* buf, size_t count, struct copy_stats* stats) {
+	while (count > 0) {
+		unsigned long long start = copy_now_ns();
+		ssize_t num_bytes_written = write(fd, buf, count);
+		if (num_bytes_written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return WRITE_ERROR;
+		}
+		copy_count_write(stats, CALL_WRITE, start);
+		buf += num_bytes_written;
+		count -= num_bytes_written;
+	}
+	return 0;
+}
+
+
+static int copy_with_file_range(int fd_src, int fd_dest, off_t* left, struct copy_stats* stats) {
+	int first = 1;
+	size_t count;
+	while ((count = next_count(*left, KERNEL_CHUNK)) > 0) {
+		unsigned long long start = copy_now_ns();
+		ssize_t num_bytes = copy_file_range(fd_src, NULL, fd_dest, NULL, count, 0);
+		if (num_bytes < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (first && is_unsupported(errno)) {
+				return NOT_SUPPORTED;
+			}
+			perror("Error in copy_file_range");
+			return WRITE_ERROR;
+		}
+		if (num_bytes == 0) {
+			return (first && !is_really_empty(fd_src)) ? NOT_SUPPORTED : 0;
+		}
+		copy_count_write(stats, CALL_COPY_FILE_RANGE, start);
+		account(stats, COPY_FILE_RANGE, num_bytes, left);
+		first = 0;
+	}
+	return 0;
+}
+
+
+static int copy_with_sendfile(int fd_src, int fd_dest, off_t* left, struct copy_stats* stats) {
+	int first = 1;
+	size_t count;
+	while ((count = next_count(*left, KERNEL_CHUNK)) > 0) {
+		unsigned long long start = copy_now_ns();
+		ssize_t num_bytes = sendfile(fd_dest, fd_src, NULL, count);
+		if (num_bytes < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (first && is_unsupported(errno)) {
+				return NOT_SUPPORTED;
+			}
+			perror("Error in sendfile");
+			return WRITE_ERROR;
+		}
+		if (num_bytes == 0) {
+			return (first && !is_really_empty(fd_src)) ? NOT_SUPPORTED : 0;
+		}
+		copy_count_write(stats, CALL_SENDFILE, start);
+		account(stats, COPY_SENDFILE, num_bytes, left);
+		first = 0;
+	}
+	return 0;
+}
+
+
+// move what is left in the pipe to the destination with read/write,
+// needed when the destination refuses the splice after the source already filled the pipe
+static int drain_pipe(int fd_pipe, int fd_dest, ssize_t count, off_t* left, struct copy_stats* stats) {
+	char buf[DRAIN_COUNT];
+	while (count > 0) {
+		ssize_t num_bytes_read = read(fd_pipe, buf, count < DRAIN_COUNT ? count : DRAIN_COUNT);
+		if (num_bytes_read < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return READ_ERROR;
+		}
+		copy_count_call(stats, CALL_READ);
+		if (write_all(fd_dest, buf, num_bytes_read, stats) < 0) {
+			return WRITE_ERROR;
+		}
+		account(stats, COPY_READ_WRITE, num_bytes_read, left);
+		count -= num_bytes_read;
+	}
+	return 0;
+}
+
+static int copy_with_splice(int fd_src, int fd_dest, off_t* left, struct copy_stats* stats) {
+	int pipefd[2];
+	if (pipe2(pipefd, O_CLOEXEC) < 0) {
+		perror("Error in creating the splice pipe");
+		return PIPE_ERROR;
+	}
+	// a bigger pipe means fewer round trips, keep the default if we aren't allowed
+	fcntl(pipefd[1], F_SETPIPE_SZ, PIPE_SIZE);
+	int chunk = fcntl(pipefd[1], F_GETPIPE_SZ);
+	if (chunk <= 0) {
+		chunk = 65536;
+	}
+
+	int ret = 0;
+	int first = 1;
+	size_t count;
+	while ((count = next_count(*left, chunk)) > 0) {
+		ssize_t num_bytes_in = splice(fd_src, NULL, pipefd[1], NULL, count, SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (num_bytes_in < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (first && is_unsupported(errno)) {
+				ret = NOT_SUPPORTED;
+				break;
+			}
+			perror("Error in splicing from source file");
+			ret = READ_ERROR;
+			break;
+		}
+		if (num_bytes_in == 0) {
+			break;
+		}
+		copy_count_call(stats, CALL_SPLICE);
+
+		while (num_bytes_in > 0) {
+			unsigned long long start = copy_now_ns();
+			ssize_t num_bytes_out = splice(pipefd[0], NULL, fd_dest, NULL, num_bytes_in, SPLICE_F_MOVE | SPLICE_F_MORE);
+			if (num_bytes_out < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				if (first && is_unsupported(errno)) {
+					// the source side works but the destination doesn't,
+					// hand over what's already in the pipe and let the next strategy continue
+					ret = drain_pipe(pipefd[0], fd_dest, num_bytes_in, left, stats);
+					if (ret < 0) {
+						perror("Error in writing to destination file");
+					}
+					else {
+						ret = NOT_SUPPORTED;
+					}
+				}
+				else {
+					perror("Error in splicing to destination file");
+					ret = WRITE_ERROR;
+				}
+				goto done;
+			}
+			copy_count_write(stats, CALL_SPLICE, start);
+			account(stats, COPY_SPLICE, num_bytes_out, left);
+			num_bytes_in -= num_bytes_out;
+			first = 0;
+		}
+	}
+
+done:
+	close(pipefd[0]);
+	close(pipefd[1]);
+	return ret;
+}
+
+
+// buffer size for the streaming copy: about 1/16 of the file so a big file takes a handful
+// of calls, between 128 KiB and 8 MiB (or just the file when it's smaller than that),
+// and always a multiple of the page size and of the preferred I/O size of both ends
+static size_t stream_buffer_size(int fd_src, int fd_dest) {
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t unit = page;
+	size_t size = STREAM_MIN_BUF;
+	struct stat st;
+
+	if (fstat(fd_dest, &st) == 0 && (size_t)st.st_blksize > unit) {
+		unit = st.st_blksize;
+	}
+	if (fstat(fd_src, &st) == 0) {
+		if ((size_t)st.st_blksize > unit) {
+			unit = st.st_blksize;
+		}
+		if (S_ISREG(st.st_mode)) {
+			if (st.st_size < STREAM_MIN_BUF) {
+				size = st.st_size > 0 ? st.st_size : 1;
+			}
+			else if (st.st_size / 16 > STREAM_MAX_BUF) {
+				size = STREAM_MAX_BUF;
+			}
+			else if (st.st_size / 16 > STREAM_MIN_BUF) {
+				size = st.st_size / 16;
+			}
+		}
+	}
+
+	unit = (unit + page - 1) / page * page;
+	return (size + unit - 1) / unit * unit;
+}
+
+// keeps a big copy from pushing everything else out of the page cache:
+// the pages of the ranges already copied are dropped one window behind the writes
+struct cache_drop {
+	off_t src_base;		// offset where the copy started in the source, -1 if it can't seek
+	off_t dest_base;	// same for the destination
+	off_t started;		// copied bytes whose writeback was already started
+	off_t dropped;		// copied bytes already dropped from the cache
+};
+
+static void drop_copied_pages(int fd_src, int fd_dest, struct cache_drop* drop, off_t copied, int last) {
+	if (!last && copied - drop->started < DROP_WINDOW) {
+		return;
+	}
+	// the last call waits for the newest window too, no later call would drop it
+	off_t end = last ? copied : drop->started;
+	off_t len = end - drop->dropped;
+
+	// these are only hints, a failure just means the pages stay cached
+	if (drop->dest_base >= 0) {
+		// start writing the newest window back and wait for the previous one,
+		// DONTNEED can't drop dirty pages
+		if (!last) {
+			sync_file_range(fd_dest, drop->dest_base + drop->started, copied - drop->started, SYNC_FILE_RANGE_WRITE);
+		}
+		if (len > 0) {
+			sync_file_range(fd_dest, drop->dest_base + drop->dropped, len,
+				SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+			posix_fadvise(fd_dest, drop->dest_base + drop->dropped, len, POSIX_FADV_DONTNEED);
+		}
+	}
+	if (drop->src_base >= 0) {
+		// the source pages are clean, everything read so far can go
+		posix_fadvise(fd_src, drop->src_base, copied, POSIX_FADV_DONTNEED);
+	}
+	drop->dropped = end;
+	drop->started = copied;
+}
+
+static int is_zero(const char* buf, size_t len) {
+	return len == 0 || (buf[0] == 0 && memcmp(buf, buf + 1, len - 1) == 0);
+}
+
+// write buf but seek over every run of all-zero blocks instead, leaving a hole there
+// (only correct because the destination was truncated, so what isn't written reads as zeros)
+static int write_sparse(int fd_dest, const char* buf, size_t len, size_t unit, struct copy_stats* stats, int* ends_in_hole) {
+	size_t pos = 0;
+	while (pos < len) {
+		size_t run = len - pos < unit ? len - pos : unit;
+		int zero = is_zero(buf + pos, run);
+		while (pos + run < len) {
+			size_t block = len - pos - run < unit ? len - pos - run : unit;
+			if (is_zero(buf + pos + run, block) != zero) {
+				break;
+			}
+			run += block;
+		}
+
+		if (zero) {
+			if (lseek(fd_dest, run, SEEK_CUR) < 0) {
+				return SEEK_ERROR;
+			}
+			stats->hole_bytes += run;
+		}
+		else if (write_all(fd_dest, buf + pos, run, stats) < 0) {
+			return WRITE_ERROR;
+		}
+		*ends_in_hole = zero;
+		pos += run;
+	}
+	return 0;
+}
+
+// drop_cache (--stream, --direct without O_DIRECT) waits for the writeback of each window to drop it from the page cache,
+// a plain fallback copy leaves the writeback to the kernel and runs at full speed
+static int copy_with_read_write(int fd_src, int fd_dest, off_t* left, int punch_holes, int drop_cache, struct copy_stats* stats) {
+	size_t size = stream_buffer_size(fd_src, fd_dest);
+	char* buf;
+	if (posix_memalign((void**)&buf, sysconf(_SC_PAGESIZE), size) != 0) {
+		perror("Unable to allocate the copy buffer");
+		return MALLOC_ERROR;
+	}
+
+	struct stat st;
+	size_t hole_unit = (fstat(fd_dest, &st) == 0 && st.st_blksize > 0) ? (size_t)st.st_blksize : 4096;
+	int ends_in_hole = 0;
+
+	struct cache_drop drop = {lseek(fd_src, 0, SEEK_CUR), lseek(fd_dest, 0, SEEK_CUR), 0, 0};
+	if (drop.src_base >= 0) {
+		posix_fadvise(fd_src, drop.src_base, 0, POSIX_FADV_SEQUENTIAL);
+	}
+
+	int ret = 0;
+	off_t copied = 0;
+	size_t count;
+	while ((count = next_count(*left, size)) > 0) {
+		ssize_t num_bytes_read = read(fd_src, buf, count);
+		if (num_bytes_read < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("Error in reading from source file");
+			ret = READ_ERROR;
+			break;
+		}
+		copy_count_call(stats, CALL_READ);
+		if (num_bytes_read == 0) {
+			break;
+		}
+		if (stats->checksummed) {
+			stats->checksum = crc32c(stats->checksum, buf, num_bytes_read);
+		}
+
+		if (punch_holes) {
+			ret = write_sparse(fd_dest, buf, num_bytes_read, hole_unit, stats, &ends_in_hole);
+		}
+		else {
+			ret = write_all(fd_dest, buf, num_bytes_read, stats);
+		}
+		if (ret < 0) {
+			perror("Error in writing to destination file");
+			break;
+		}
+		account(stats, COPY_READ_WRITE, num_bytes_read, left);
+		copied += num_bytes_read;
+		if (drop_cache) {
+			drop_copied_pages(fd_src, fd_dest, &drop, copied, 0);
+		}
+	}
+
+	// a hole at the very end has no size until the file is extended over it
+	if (ret == 0 && ends_in_hole) {
+		off_t end = lseek(fd_dest, 0, SEEK_CUR);
+		if (end < 0 || ftruncate(fd_dest, end) < 0) {
+			perror("Error in setting the size of destination file");
+			ret = TRUNCATE_ERROR;
+		}
+		copy_count_call(stats, CALL_TRUNCATE);
+	}
+	if (ret == 0 && drop_cache && copied >= DROP_WINDOW) {
+		drop_copied_pages(fd_src, fd_dest, &drop, copied, 1);
+	}
+	free(buf);
+	return ret;
+}
+
+
+// copy at most left bytes (left < 0 means until EOF), starting with the strategy that
+// already worked earlier in this copy (stats->strategy) when there is one
+static int copy_range(int fd_src, int fd_dest, off_t left, const struct copy_options* opts, struct copy_stats* stats) {
+	enum copy_strategy from = stats->strategy;
+	int user_space_only = opts->stream || opts->direct || opts->sparse == SPARSE_ALWAYS || opts->verify != VERIFY_NONE;
+
+	int ret = NOT_SUPPORTED;
+	if (!user_space_only) {
+		if (from <= COPY_FILE_RANGE) {
+			ret = copy_with_file_range(fd_src, fd_dest, &left, stats);
+		}
+		if (ret == NOT_SUPPORTED && from <= COPY_SENDFILE) {
+			ret = copy_with_sendfile(fd_src, fd_dest, &left, stats);
+		}
+		if (ret == NOT_SUPPORTED && from <= COPY_SPLICE) {
+			ret = copy_with_splice(fd_src, fd_dest, &left, stats);
+		}
+	}
+	if (ret == NOT_SUPPORTED) {
+		ret = copy_with_read_write(fd_src, fd_dest, &left, opts->sparse == SPARSE_ALWAYS, opts->stream || opts->direct, stats);
+	}
+	return ret;
+}
+
+
+// make the destination share the extents of the source instead of copying them,
+// an O(1) metadata operation on file systems with reflinks (btrfs, XFS)
+static int copy_with_clone(int fd_src, int fd_dest, struct copy_stats* stats) {
+	struct stat st;
+	off_t src_base = lseek(fd_src, 0, SEEK_CUR);
+	off_t dest_base = lseek(fd_dest, 0, SEEK_CUR);
+	if (fstat(fd_src, &st) < 0 || !S_ISREG(st.st_mode) || src_base < 0 || dest_base < 0) {
+		errno = EINVAL;
+		return NOT_SUPPORTED;
+	}
+	if (src_base >= st.st_size) {
+		return 0;
+	}
+
+	int ret;
+	unsigned long long start = copy_now_ns();
+	if (src_base == 0 && dest_base == 0) {
+		ret = ioctl(fd_dest, FICLONE, fd_src);
+	}
+	else {
+		// length 0 means up to the end of the source
+		struct file_clone_range range = {fd_src, src_base, 0, dest_base};
+		ret = ioctl(fd_dest, FICLONERANGE, &range);
+	}
+	if (ret < 0) {
+		// ENOTTY and EOPNOTSUPP come from file systems without reflinks (ext4, tmpfs),
+		// EXDEV from two different file systems, EINVAL from unaligned offsets
+		return (is_unsupported(errno) || errno == ENOTTY) ? NOT_SUPPORTED : CLONE_ERROR;
+	}
+	off_t unbounded = -1;
+	copy_count_write(stats, CALL_CLONE, start);
+	account(stats, COPY_CLONE, st.st_size - src_base, &unbounded);
+
+	if (lseek(fd_src, st.st_size, SEEK_SET) < 0 || lseek(fd_dest, dest_base + (st.st_size - src_base), SEEK_SET) < 0) {
+		perror("Error in seeking to the end of the copy");
+		return SEEK_ERROR;
+	}
+	return 0;
+}
+
+
+// copy only the data extents of a sparse source: SEEK_DATA/SEEK_HOLE find them, the holes
+// between them are recreated by seeking over them in the destination and the final size
+// (which covers a trailing hole) is set with ftruncate
+static int copy_sparse_extents(int fd_src, int fd_dest, off_t size, const struct copy_options* opts, struct copy_stats* stats) {
+	off_t src_base = lseek(fd_src, 0, SEEK_CUR);
+	off_t dest_base = lseek(fd_dest, 0, SEEK_CUR);
+	if (src_base < 0 || dest_base < 0) {
+		return NOT_SUPPORTED;
+	}
+
+	off_t pos = src_base;
+	while (pos < size) {
+		off_t data = lseek(fd_src, pos, SEEK_DATA);
+		if (data < 0) {
+			if (errno == ENXIO) {
+				break; // only a hole is left
+			}
+			if (pos == src_base && is_unsupported(errno)) {
+				return NOT_SUPPORTED;
+			}
+			perror("Error in seeking to data in source file");
+			return SEEK_ERROR;
+		}
+		off_t hole = lseek(fd_src, data, SEEK_HOLE);
+		if (hole < 0 || lseek(fd_src, data, SEEK_SET) < 0 || lseek(fd_dest, dest_base + (data - src_base), SEEK_SET) < 0) {
+			perror("Error in seeking over a hole");
+			return SEEK_ERROR;
+		}
+		stats->bytes += data - pos;
+		stats->hole_bytes += data - pos;
+		if (stats->checksummed) {
+			stats->checksum = crc32c_zeros(stats->checksum, data - pos);
+		}
+
+		int ret = copy_range(fd_src, fd_dest, hole - data, opts, stats);
+		if (ret < 0) {
+			return ret;
+		}
+		pos = hole;
+	}
+
+	if (pos < size) {
+		stats->bytes += size - pos;
+		stats->hole_bytes += size - pos;
+		if (stats->checksummed) {
+			stats->checksum = crc32c_zeros(stats->checksum, size - pos);
+		}
+	}
+	if (ftruncate(fd_dest, dest_base + (size - src_base)) < 0) {
+		perror("Error in setting the size of destination file");
+		return TRUNCATE_ERROR;
+	}
+	copy_count_call(stats, CALL_TRUNCATE);
+	if (lseek(fd_src, size, SEEK_SET) < 0 || lseek(fd_dest, dest_base + (size - src_base), SEEK_SET) < 0) {
+		perror("Error in seeking to the end of the copy");
+		return SEEK_ERROR;
+	}
+	return 0;
+}
+
+
+static int copy_dispatch(int fd_src, int fd_dest, const struct copy_options* opts, struct copy_stats* stats) {
+	// before the clone, which would replace the destination instead of updating it
+	if (opts->delta) {
+		int ret = copy_fd_delta(fd_src, fd_dest, opts, stats);
+		if (ret != NOT_SUPPORTED) {
+			return ret;
+		}
+	}
+
+	if (opts->reflink != REFLINK_NEVER) {
+		int ret = copy_with_clone(fd_src, fd_dest, stats);
+		if (ret == NOT_SUPPORTED && opts->reflink == REFLINK_ALWAYS) {
+			ret = CLONE_ERROR;
+		}
+		if (ret == CLONE_ERROR) {
+			perror("Error in cloning source file");
+		}
+		if (ret != NOT_SUPPORTED) {
+			return ret;
+		}
+	}
+
+	if (opts->direct) {
+		// without O_DIRECT the streaming copy still keeps the page cache clean
+		int ret = copy_fd_direct(fd_src, fd_dest, stats);
+		if (ret != NOT_SUPPORTED) {
+			return ret;
+		}
+	}
+	if (opts->pipeline) {
+		return copy_fd_pipeline(fd_src, fd_dest, stats);
+	}
+
+	struct stat st_src, st_dest;
+	int both_regular = fstat(fd_src, &st_src) == 0 && fstat(fd_dest, &st_dest) == 0
+		&& S_ISREG(st_src.st_mode) && S_ISREG(st_dest.st_mode);
+
+	// walk the extents when the source has fewer blocks than its size says (it has holes),
+	// or always with --sparse=always, since zero runs inside the data become holes too
+	// (before the chunks of --parallel, which would write the holes as data)
+	if (opts->sparse != SPARSE_NEVER && both_regular
+		&& (opts->sparse == SPARSE_ALWAYS || (off_t)st_src.st_blocks * 512 < st_src.st_size)) {
+		int ret = copy_sparse_extents(fd_src, fd_dest, st_src.st_size, opts, stats);
+		if (ret != NOT_SUPPORTED) {
+			return ret;
+		}
+	}
+
+	// a file smaller than two chunks isn't worth the threads
+	off_t chunk_size = opts->chunk_size > 0 ? opts->chunk_size : DEFAULT_CHUNK_SIZE;
+	if (opts->parallel && both_regular && st_src.st_size >= 2 * chunk_size) {
+		return copy_fd_parallel(fd_src, fd_dest, st_src.st_size, opts, stats);
+	}
+	int ret = copy_range(fd_src, fd_dest, -1, opts, stats);
+
+	// --delta didn't truncate, whatever the old destination had past the copy has to go
+	if (ret == 0 && opts->delta && fstat(fd_dest, &st_dest) == 0 && S_ISREG(st_dest.st_mode)) {
+		off_t end = lseek(fd_dest, 0, SEEK_CUR);
+		if (end < 0 || ftruncate(fd_dest, end) < 0) {
+			perror("Error in setting the size of destination file");
+			ret = TRUNCATE_ERROR;
+		}
+		copy_count_call(stats, CALL_TRUNCATE);
+	}
+	return ret;
+}
+
+int copy_fd(int fd_src, int fd_dest, const struct copy_options* opts, struct copy_stats* stats) {
+	static const struct copy_options default_options;
+	if (opts == NULL) {
+		opts = &default_options;
+	}
+	memset(stats, 0, sizeof(struct copy_stats));
+	stats->strategy = COPY_NONE;
+	stats->threads = 1;
+	stats->checksummed = opts->verify != VERIFY_NONE;
+
+	// where the copy starts, so that --verify can read it again (-1 for pipes)
+	off_t src_base = lseek(fd_src, 0, SEEK_CUR);
+	off_t dest_base = lseek(fd_dest, 0, SEEK_CUR);
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	int ret = copy_dispatch(fd_src, fd_dest, opts, stats);
+	if (ret == 0 && opts->verify != VERIFY_NONE) {
+		ret = copy_verify(fd_src, fd_dest, src_base, dest_base, opts->verify, stats);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	stats->nanoseconds = (end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+	return ret;
+}
+
+
+unsigned long long copy_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void copy_count_call(struct copy_stats* stats, enum copy_call kind) {
+	stats->calls++;
+	stats->calls_by_kind[kind]++;
+}
+
+void copy_count_write(struct copy_stats* stats, enum copy_call kind, unsigned long long start_ns) {
+	copy_count_call(stats, kind);
+	unsigned long long ns = copy_now_ns() - start_ns;
+	int bucket = 0;
+	if (ns >= 1024) {
+		bucket = 63 - __builtin_clzll(ns) - 9; // 2^10 ns lands in bucket 1
+	}
+	if (bucket >= LATENCY_BUCKETS) {
+		bucket = LATENCY_BUCKETS - 1;
+	}
+	stats->write_latency[bucket]++;
+}
+
+void copy_stats_add(struct copy_stats* total, const struct copy_stats* part) {
+	if (part->strategy != COPY_NONE) {
+		total->strategy = part->strategy;
+	}
+	total->bytes += part->bytes;
+	total->calls += part->calls;
+	total->hole_bytes += part->hole_bytes;
+	total->skipped_bytes += part->skipped_bytes;
+	for (int i = 0; i < CALL_KINDS; i++) {
+		total->calls_by_kind[i] += part->calls_by_kind[i];
+	}
+	for (int i = 0; i < LATENCY_BUCKETS; i++) {
+		total->write_latency[i] += part->write_latency[i];
+	}
+}
+
+
+const char* copy_call_name(enum copy_call kind) {
+	switch (kind) {
+		case CALL_READ:			return "read";
+		case CALL_WRITE:		return "write";
+		case CALL_PREAD:		return "pread";
+		case CALL_PWRITE:		return "pwrite";
+		case CALL_COPY_FILE_RANGE:	return "copy_file_range";
+		case CALL_SENDFILE:		return "sendfile";
+		case CALL_SPLICE:		return "splice";
+		case CALL_CLONE:		return "ficlone";
+		case CALL_URING:		return "io_uring_enter";
+		case CALL_TRUNCATE:		return "ftruncate";
+		case CALL_SYNC:			return "sync";
+		default:			return "other";
+	}
+}
+
+const char* copy_strategy_name(enum copy_strategy strategy) {
+	switch (strategy) {
+		case COPY_CLONE:	return "clone";
+		case COPY_FILE_RANGE:	return "copy_file_range";
+		case COPY_SENDFILE:	return "sendfile";
+		case COPY_SPLICE:	return "splice";
+		case COPY_READ_WRITE:	return "read/write";
+		case COPY_PIPELINE:	return "pipeline";
+		case COPY_DIRECT:	return "O_DIRECT";
+		case COPY_URING:	return "io_uring";
+		case COPY_DELTA:	return "delta";
+		case COPY_RENAME:	return "rename";
+		default:		return "none";
+	}
+}
+
+
+void copy_report(FILE* stream, const char* prog, const char* src, const char* dest, const struct copy_stats* stats) {
+	unsigned long long per_call = stats->calls ? stats->bytes / stats->calls : 0;
+	fprintf(stream, "%s: '%s' -> '%s': %s, %llu bytes in %llu calls (%llu bytes/call)",
+		prog, src, dest, copy_strategy_name(stats->strategy), stats->bytes, stats->calls, per_call);
+	if (stats->hole_bytes > 0) {
+		fprintf(stream, ", %llu bytes left as holes", stats->hole_bytes);
+	}
+	if (stats->strategy == COPY_DELTA) {
+		fprintf(stream, ", %llu bytes unchanged, %llu bytes rewritten", stats->skipped_bytes, stats->bytes - stats->skipped_bytes - stats->hole_bytes);
+	}
+	if (stats->threads > 1) {
+		fprintf(stream, ", %d threads", stats->threads);
+	}
+	if (stats->strategy == COPY_PIPELINE) {
+		// whichever side waited longer was waiting for the bottleneck
+		fprintf(stream, ", reader stalled %.3f s on the destination, writer stalled %.3f s on the source",
+			stats->read_stall_ns / 1e9, stats->write_stall_ns / 1e9);
+	}
+	if (stats->verified) {
+		fprintf(stream, ", verified (crc32c %08x)", stats->checksum);
+	}
+	double seconds = stats->nanoseconds / 1e9;
+	fprintf(stream, ", %.3f s", seconds);
+	if (seconds > 0) {
+		fprintf(stream, " (%.1f MiB/s)", stats->bytes / seconds / (1024 * 1024));
+	}
+	fprintf(stream, "\n");
+}
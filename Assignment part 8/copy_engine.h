@@ -0,0 +1,181 @@
+#ifndef COPY_ENGINE_H
+#define COPY_ENGINE_H
+
+#include <stdio.h>	// to use FILE
+#include <sys/types.h>	// to use off_t
+
+#define ARGUMENT_ERROR -1
+#define WRITE_ERROR    -2
+#define OPEN_ERROR     -3
+#define READ_ERROR     -4
+#define CLOSE_ERROR    -5
+#define UNLINK_ERROR   -6
+#define PIPE_ERROR     -7
+#define MALLOC_ERROR   -8
+#define SEEK_ERROR     -9
+#define TRUNCATE_ERROR -10
+#define CLONE_ERROR    -11
+#define THREAD_ERROR   -12
+#define VERIFY_ERROR   -13
+
+// returned (instead of an error) by the copy functions that can't handle the given
+// descriptors, nothing was lost and the caller goes on with another strategy
+#define NOT_SUPPORTED 1
+
+#define DEFAULT_CHUNK_SIZE (64 * 1024 * 1024)	// --parallel splits the file in chunks of this size
+
+// strategies the engine tries, in this order, until one of them is supported
+// by the pair of file descriptors (kernel-side copies first, user space last)
+enum copy_strategy {
+	COPY_NONE = 0,		// nothing copied yet (empty source)
+	COPY_CLONE,		// FICLONE/FICLONERANGE, the destination shares the source extents
+	COPY_FILE_RANGE,	// copy_file_range(), data never leaves the kernel
+	COPY_SENDFILE,		// sendfile(), data never leaves the kernel
+	COPY_SPLICE,		// splice() through a pipe, data never leaves the kernel
+	COPY_READ_WRITE,	// read() + write() through a user space buffer
+	COPY_PIPELINE,		// a reader and a writer thread sharing a ring of buffers
+	COPY_DIRECT,		// read() + write() with O_DIRECT, bypassing the page cache
+	COPY_URING,		// batched statx/openat/read/write/close through io_uring
+	COPY_DELTA,		// compare with the old destination and write only the blocks that differ
+	COPY_RENAME		// mv: rename() moved the name, no data was copied
+};
+
+// how holes in the source are handled (--sparse=WHEN)
+enum copy_sparse {
+	SPARSE_AUTO = 0,	// keep the holes of a sparse source (SEEK_DATA/SEEK_HOLE)
+	SPARSE_NEVER,		// write every byte, holes become real zeros
+	SPARSE_ALWAYS		// keep the holes and also turn runs of zero blocks into holes
+};
+
+// how the files of a tree are copied (--engine=NAME)
+enum copy_engine {
+	ENGINE_SYNC = 0,	// every worker copies one file at a time with copy_fd
+	ENGINE_URING		// workers submit small files in batches to their own io_uring
+};
+
+// how --verify reads the destination back
+enum verify_mode {
+	VERIFY_NONE = 0,
+	VERIFY_BUFFERED,	// flush and drop the written pages, then read them again from the disk
+	VERIFY_DIRECT		// read the destination with O_DIRECT
+};
+
+// whether the destination may share the data blocks of the source (--reflink=WHEN)
+enum copy_reflink {
+	REFLINK_AUTO = 0,	// clone when the file system can (btrfs, XFS), copy otherwise
+	REFLINK_NEVER,		// always copy the data
+	REFLINK_ALWAYS		// clone or fail
+};
+
+// when the copied data is forced to the disk (--sync=POLICY)
+enum sync_policy {
+	SYNC_NONE = 0,		// never, the kernel writes it back when it wants (cp's default)
+	SYNC_FILE,		// fdatasync every file before it's closed
+	SYNC_BATCH,		// start the writeback of every file and wait for a group of them at once
+	SYNC_FS			// one syncfs of the destination file system at the end (mv's default)
+};
+
+struct copy_options {
+	int verbose;		// report what the copy did on stderr
+	int stream;		// skip the kernel-side strategies, stream through a big buffer
+				// and drop the pages already copied from the page cache
+	enum copy_sparse sparse;
+	enum copy_reflink reflink;
+	int recursive;		// copy directories with everything under them
+	int threads;		// worker threads for the tree and chunked copies, 0 picks a number from the CPU count
+	int parallel;		// copy big files as chunks at their offsets from several threads
+	off_t chunk_size;	// size of those chunks, 0 for DEFAULT_CHUNK_SIZE
+	int pipeline;		// read and write from two threads so two different devices work at the same time
+	int direct;		// bypass the page cache with O_DIRECT on both ends
+	enum copy_engine engine;
+	enum verify_mode verify;	// checksum the data while it's copied and compare with the destination
+	int delta;		// keep the destination and rewrite only the blocks that changed
+	enum sync_policy sync;
+	int break_links;	// tree copies: copy every link of a hard linked file as a separate file
+};
+
+// syscalls that move data, counted by kind in copy_stats (--stats)
+enum copy_call {
+	CALL_READ = 0,
+	CALL_WRITE,
+	CALL_PREAD,
+	CALL_PWRITE,
+	CALL_COPY_FILE_RANGE,
+	CALL_SENDFILE,
+	CALL_SPLICE,
+	CALL_CLONE,		// ioctl FICLONE/FICLONERANGE
+	CALL_URING,		// io_uring_enter
+	CALL_TRUNCATE,		// ftruncate setting the final size
+	CALL_SYNC,		// fdatasync, sync_file_range and syncfs of --sync
+	CALL_KINDS
+};
+
+// histogram of the time every call putting data in the destination took: bucket 0 counts
+// the calls under 1 us, bucket i those between 2^(9+i) and 2^(10+i) ns, the last one the rest
+#define LATENCY_BUCKETS 24
+
+struct copy_stats {
+	enum copy_strategy strategy;	// strategy that moved the last byte
+	unsigned long long bytes;	// size of the data produced in the destination
+	unsigned long long calls;	// syscalls issued to move the data (and to flush it)
+	unsigned long long hole_bytes;	// part of bytes left as holes instead of being written
+	unsigned long long nanoseconds;	// wall time of the copy
+	int threads;			// threads that moved the data
+	unsigned long long read_stall_ns;	// --pipeline: time the reader waited for a free buffer
+	unsigned long long write_stall_ns;	// --pipeline: time the writer waited for a full buffer
+	unsigned int checksum;		// --verify: CRC32C of the data
+	int checksummed;		// --verify: the data was hashed while it went through a buffer,
+					// cleared by the strategies that don't see it (kernel-side, chunks)
+	int verified;			// --verify: the destination was read back and matched
+	unsigned long long skipped_bytes;	// --delta: part of bytes the destination already had
+	unsigned long long calls_by_kind[CALL_KINDS];	// calls split by enum copy_call
+	unsigned long long write_latency[LATENCY_BUCKETS];
+};
+
+// copy everything from the current offset of fd_src to the current offset of fd_dest,
+// opts may be NULL for the defaults, the destination is expected to be empty past its offset
+// (freshly truncated) because holes are made by not writing, except with opts->delta
+// where it has to be open for reading too and keeps what already matches
+// returns 0 on success or one of the negative error codes above (errno is kept)
+int copy_fd(int fd_src, int fd_dest, const struct copy_options* opts, struct copy_stats* stats);
+
+// --parallel: preallocate the destination and copy the source (up to size) as chunks
+// from several threads with copy_file_range at explicit offsets or pread/pwrite,
+// called by copy_fd for regular files of at least two chunks
+int copy_fd_parallel(int fd_src, int fd_dest, off_t size, const struct copy_options* opts, struct copy_stats* stats);
+
+// --pipeline: a reader thread fills a ring of aligned buffers while the calling thread
+// writes them out, so a slow source and a slow destination overlap instead of taking turns
+int copy_fd_pipeline(int fd_src, int fd_dest, struct copy_stats* stats);
+
+// --direct: switch both descriptors to O_DIRECT and copy through an aligned buffer from a
+// shared pool, the unaligned tail is written through the page cache, returns NOT_SUPPORTED
+// when the offsets aren't aligned or a file system refuses O_DIRECT
+int copy_fd_direct(int fd_src, int fd_dest, struct copy_stats* stats);
+
+// --verify: read stats->bytes back from fd_dest (reopened for reading) starting at dest_base
+// and compare their CRC32C with stats->checksum, the source is read again from src_base
+// first when the copy didn't hash it, returns 0 or VERIFY_ERROR
+int copy_verify(int fd_src, int fd_dest, off_t src_base, off_t dest_base, enum verify_mode mode, struct copy_stats* stats);
+
+// --delta: read both regular files in units spread over several threads, compare them
+// block by block, pwrite only the blocks that differ and set the final size,
+// returns NOT_SUPPORTED when one of them isn't a regular file
+int copy_fd_delta(int fd_src, int fd_dest, const struct copy_options* opts, struct copy_stats* stats);
+
+// monotonic clock in ns, to time a call for copy_count_write
+unsigned long long copy_now_ns(void);
+// count one call of the given kind, copy_count_write also puts the time since start_ns in the histogram
+void copy_count_call(struct copy_stats* stats, enum copy_call kind);
+void copy_count_write(struct copy_stats* stats, enum copy_call kind, unsigned long long start_ns);
+// add the counters of part (a thread, a file) to total
+void copy_stats_add(struct copy_stats* total, const struct copy_stats* part);
+const char* copy_call_name(enum copy_call kind);
+
+const char* copy_strategy_name(enum copy_strategy strategy);
+
+// print "<prog>: '<src>' -> '<dest>': <strategy>, <bytes> bytes in <calls> calls (<avg> bytes/call)"
+// followed by the time and throughput
+void copy_report(FILE* stream, const char* prog, const char* src, const char* dest, const struct copy_stats* stats);
+
+#endif
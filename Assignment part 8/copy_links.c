@@ -0,0 +1,166 @@
+#include <stdlib.h>		// to use calloc, realloc, free
+#include <string.h>		// to use strlen, memcpy
+
+#include "copy_links.h"
+
+#define LINK_MAP_MIN  1024	// initial number of slots, always a power of 2
+#define LINK_POOL_MIN (64 * 1024)
+
+
+struct link_map {
+	struct link_entry* slots;
+	unsigned char* used;	// a byte per slot, a zero (dev, ino) is a valid key
+	size_t size;		// number of slots
+	size_t count;
+	char* pool;		// the destination paths, one after the other
+	size_t pool_len;
+	size_t pool_size;
+};
+
+
+static size_t hash(dev_t dev, ino_t ino) {
+	unsigned long long key = (unsigned long long)ino ^ ((unsigned long long)dev << 40);
+	key *= 0x9e3779b97f4a7c15ULL;	// Fibonacci hashing, the top bits are the best mixed
+	return key ^ (key >> 32);
+}
+
+static int alloc_slots(struct link_map* map, size_t size) {
+	map->slots = malloc(size * sizeof(struct link_entry));
+	map->used = calloc(size, 1);
+	if (map->slots == NULL || map->used == NULL) {
+		free(map->slots);
+		free(map->used);
+		return -1;
+	}
+	map->size = size;
+	return 0;
+}
+
+// double the slots when 3/4 are used, so the probes stay short
+static int grow(struct link_map* map) {
+	struct link_entry* old_slots = map->slots;
+	unsigned char* old_used = map->used;
+	size_t old_size = map->size;
+	if (alloc_slots(map, old_size * 2) < 0) {
+		map->slots = old_slots;
+		map->used = old_used;
+		return -1;
+	}
+	for (size_t i = 0; i < old_size; i++) {
+		if (old_used[i]) {
+			size_t slot = hash(old_slots[i].dev, old_slots[i].ino) & (map->size - 1);
+			while (map->used[slot]) {
+				slot = (slot + 1) & (map->size - 1);
+			}
+			map->slots[slot] = old_slots[i];
+			map->used[slot] = 1;
+		}
+	}
+	free(old_slots);
+	free(old_used);
+	return 0;
+}
+
+
+struct link_map* link_map_new(void) {
+	struct link_map* map = calloc(1, sizeof(struct link_map));
+	if (map == NULL) {
+		return NULL;
+	}
+	if (alloc_slots(map, LINK_MAP_MIN) < 0) {
+		free(map);
+		return NULL;
+	}
+	return map;
+}
+
+void link_map_free(struct link_map* map) {
+	if (map != NULL) {
+		free(map->slots);
+		free(map->used);
+		free(map->pool);
+		free(map);
+	}
+}
+
+
+struct link_entry* link_map_find(struct link_map* map, dev_t dev, ino_t ino) {
+	size_t slot = hash(dev, ino) & (map->size - 1);
+	while (map->used[slot]) {
+		if (map->slots[slot].ino == ino && map->slots[slot].dev == dev) {
+			return &map->slots[slot];
+		}
+		slot = (slot + 1) & (map->size - 1);
+	}
+	return NULL;
+}
+
+struct link_entry* link_map_add(struct link_map* map, dev_t dev, ino_t ino, nlink_t nlink, const char* path) {
+	if ((map->count + 1) * 4 > map->size * 3 && grow(map) < 0) {
+		return NULL;
+	}
+	size_t len = strlen(path) + 1;
+	if (map->pool_len + len > map->pool_size) {
+		size_t pool_size = map->pool_size == 0 ? LINK_POOL_MIN : map->pool_size;
+		while (map->pool_len + len > pool_size) {
+			pool_size *= 2;
+		}
+		char* pool = realloc(map->pool, pool_size);
+		if (pool == NULL) {
+			return NULL;
+		}
+		map->pool = pool;
+		map->pool_size = pool_size;
+	}
+	memcpy(map->pool + map->pool_len, path, len);
+
+	size_t slot = hash(dev, ino) & (map->size - 1);
+	while (map->used[slot]) {
+		slot = (slot + 1) & (map->size - 1);
+	}
+	struct link_entry* entry = &map->slots[slot];
+	entry->dev = dev;
+	entry->ino = ino;
+	entry->remaining = nlink - 1;
+	entry->state = LINK_COPYING;
+	entry->path = map->pool_len;
+	map->used[slot] = 1;
+	map->pool_len += len;
+	map->count++;
+	return entry;
+}
+
+const char* link_map_path(const struct link_map* map, const struct link_entry* entry) {
+	return map->pool + entry->path;
+}
+
+void link_map_seen(struct link_map* map, struct link_entry* entry) {
+	if (entry->remaining > 1) {
+		entry->remaining--;
+		return;
+	}
+
+	// backward shift deletion: pull the following entries of the cluster back
+	// into the hole when that is still on their probe path, so no tombstones are needed
+	size_t hole = entry - map->slots;
+	size_t slot = hole;
+	map->used[hole] = 0;
+	while (1) {
+		slot = (slot + 1) & (map->size - 1);
+		if (!map->used[slot]) {
+			break;
+		}
+		size_t home = hash(map->slots[slot].dev, map->slots[slot].ino) & (map->size - 1);
+		// move it unless its home lies cyclically in (hole, slot]
+		if (((slot - home) & (map->size - 1)) >= ((slot - hole) & (map->size - 1))) {
+			map->slots[hole] = map->slots[slot];
+			map->used[hole] = 1;
+			map->used[slot] = 0;
+			hole = slot;
+		}
+	}
+	// the pool can only be reused as a whole, once no entry points into it
+	if (--map->count == 0) {
+		map->pool_len = 0;
+	}
+}
@@ -0,0 +1,43 @@
+#ifndef COPY_LINKS_H
+#define COPY_LINKS_H
+
+#include <sys/types.h>	// to use dev_t, ino_t, nlink_t
+
+// what became of the first link of a hard linked source file
+enum link_state {
+	LINK_COPYING = 0,	// a worker is creating it, the other links wait
+	LINK_READY,		// the destination exists, the other links are linked to it
+	LINK_FAILED		// it couldn't be created, the other links are copied
+};
+
+// a source inode with more than one link, and where its first link was copied to
+struct link_entry {
+	dev_t dev;
+	ino_t ino;
+	unsigned int remaining;		// links not seen yet, the entry goes away at 0
+	enum link_state state;
+	size_t path;			// offset of the destination path in the map's string pool
+};
+
+// (dev, ino) -> link_entry, open addressing with linear probing; the paths are kept
+// in one growing pool instead of a malloc each, and entries whose links were all
+// seen are removed, so the map only holds the inodes that still have links to come
+// not thread safe, the tree copy uses it under its lock
+struct link_map;
+
+struct link_map* link_map_new(void);
+void link_map_free(struct link_map* map);
+
+// NULL when (dev, ino) isn't there, the pointer is only valid until the next link_map_add
+struct link_entry* link_map_find(struct link_map* map, dev_t dev, ino_t ino);
+
+// add an inode with nlink links whose first link was copied to path, state LINK_COPYING,
+// NULL when the memory ran out
+struct link_entry* link_map_add(struct link_map* map, dev_t dev, ino_t ino, nlink_t nlink, const char* path);
+
+const char* link_map_path(const struct link_map* map, const struct link_entry* entry);
+
+// one more link of entry was linked, removes it after the last one
+void link_map_seen(struct link_map* map, struct link_entry* entry);
+
+#endif
@@ -0,0 +1,175 @@
+#include <sys/resource.h>	// to use getrusage
+#include <string.h>		// to use strcmp, strncmp
+#include <stdio.h>		// to use fprintf, fopen, fclose, perror
+#include <time.h>		// to use clock_gettime
+
+#include "copy_metrics.h"
+
+#define BAR_WIDTH 40
+
+
+static double timeval_seconds(struct timeval tv) {
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// lower bound of a latency bucket, "512 ns", "4 us", "2 ms"...
+static void bucket_label(char* buf, size_t size, int bucket) {
+	unsigned long long ns = bucket == 0 ? 0 : 1ULL << (9 + bucket);
+	if (ns < 1000) {
+		snprintf(buf, size, "%llu ns", ns);
+	}
+	else if (ns < 1000000) {
+		snprintf(buf, size, "%llu us", ns / 1000);
+	}
+	else if (ns < 1000000000) {
+		snprintf(buf, size, "%llu ms", ns / 1000000);
+	}
+	else {
+		snprintf(buf, size, "%llu s", ns / 1000000000);
+	}
+}
+
+// argv[0] is the only string that isn't ours
+static void json_string(FILE* stream, const char* str) {
+	fputc('"', stream);
+	for (; *str != '\0'; str++) {
+		if (*str == '"' || *str == '\\') {
+			fprintf(stream, "\\%c", *str);
+		}
+		else if ((unsigned char)*str < 0x20) {
+			fprintf(stream, "\\u%04x", *str);
+		}
+		else {
+			fputc(*str, stream);
+		}
+	}
+	fputc('"', stream);
+}
+
+static void report_human(FILE* stream, const char* prog, unsigned long long files, const struct copy_stats* stats,
+	double wall, double user, double sys) {
+	fprintf(stream, "%s: stats: %llu files, %llu bytes, strategy %s", prog, files, stats->bytes, copy_strategy_name(stats->strategy));
+	if (stats->hole_bytes > 0) {
+		fprintf(stream, ", %llu bytes as holes", stats->hole_bytes);
+	}
+	if (stats->skipped_bytes > 0) {
+		fprintf(stream, ", %llu bytes unchanged", stats->skipped_bytes);
+	}
+	fprintf(stream, "\n%s: stats: wall %.3f s, user %.3f s, sys %.3f s", prog, wall, user, sys);
+	if (wall > 0 && stats->bytes > 0) {
+		fprintf(stream, ", %.1f MiB/s", stats->bytes / wall / (1024 * 1024));
+	}
+	fprintf(stream, "\n%s: stats: %llu syscalls", prog, stats->calls);
+	for (int kind = 0; kind < CALL_KINDS; kind++) {
+		if (stats->calls_by_kind[kind] > 0) {
+			fprintf(stream, ", %s %llu", copy_call_name(kind), stats->calls_by_kind[kind]);
+		}
+	}
+	fprintf(stream, "\n");
+
+	unsigned long long most = 0;
+	for (int i = 0; i < LATENCY_BUCKETS; i++) {
+		if (stats->write_latency[i] > most) {
+			most = stats->write_latency[i];
+		}
+	}
+	if (most == 0) {
+		return;
+	}
+	fprintf(stream, "%s: stats: write latency\n", prog);
+	for (int i = 0; i < LATENCY_BUCKETS; i++) {
+		if (stats->write_latency[i] == 0) {
+			continue;
+		}
+		char label[32];
+		bucket_label(label, sizeof(label), i);
+		int width = (int)(stats->write_latency[i] * BAR_WIDTH / most);
+		fprintf(stream, "  >= %-7s %10llu %.*s\n", label, stats->write_latency[i],
+			width > 0 ? width : 1, "########################################");
+	}
+}
+
+static void report_json(FILE* stream, const char* prog, unsigned long long files, const struct copy_stats* stats,
+	double wall, double user, double sys) {
+	fprintf(stream, "{\"prog\":");
+	json_string(stream, prog);
+	fprintf(stream, ",\"files\":%llu,\"bytes\":%llu,\"hole_bytes\":%llu,\"skipped_bytes\":%llu,\"strategy\":\"%s\"",
+		files, stats->bytes, stats->hole_bytes, stats->skipped_bytes, copy_strategy_name(stats->strategy));
+	fprintf(stream, ",\"wall_s\":%.6f,\"user_s\":%.6f,\"sys_s\":%.6f,\"bytes_per_s\":%.0f",
+		wall, user, sys, wall > 0 ? stats->bytes / wall : 0.0);
+	fprintf(stream, ",\"syscalls\":{\"total\":%llu", stats->calls);
+	for (int kind = 0; kind < CALL_KINDS; kind++) {
+		fprintf(stream, ",\"%s\":%llu", copy_call_name(kind), stats->calls_by_kind[kind]);
+	}
+	// [lower bound in ns, count] for every bucket, the last one has no upper bound
+	fprintf(stream, "},\"write_latency_ns\":[");
+	for (int i = 0; i < LATENCY_BUCKETS; i++) {
+		fprintf(stream, "%s[%llu,%llu]", i > 0 ? "," : "", i == 0 ? 0 : 1ULL << (9 + i), stats->write_latency[i]);
+	}
+	fprintf(stream, "]}\n");
+}
+
+
+int metrics_parse_option(const char* prog, const char* arg, struct copy_metrics* metrics) {
+	if (strcmp(arg, "--stats") == 0 || strcmp(arg, "--stats=human") == 0) {
+		metrics->format = STATS_HUMAN;
+	}
+	else if (strcmp(arg, "--stats=json") == 0) {
+		metrics->format = STATS_JSON;
+	}
+	else if (strncmp(arg, "--stats=", 8) == 0) {
+		fprintf(stderr, "%s: invalid argument '%s' for '--stats'\n", prog, arg + 8);
+		return ARGUMENT_ERROR;
+	}
+	else if (strncmp(arg, "--stats-file=", 13) == 0) {
+		if (arg[13] == '\0') {
+			fprintf(stderr, "%s: missing file name for '--stats-file'\n", prog);
+			return ARGUMENT_ERROR;
+		}
+		metrics->path = arg + 13;
+		if (metrics->format == STATS_NONE) {
+			metrics->format = STATS_JSON;
+		}
+	}
+	else {
+		return 0;
+	}
+	return 1;
+}
+
+void metrics_start(struct copy_metrics* metrics) {
+	metrics->start_ns = copy_now_ns();
+	getrusage(RUSAGE_SELF, &metrics->start_usage);
+}
+
+int metrics_report(const struct copy_metrics* metrics, const char* prog, unsigned long long files, const struct copy_stats* stats) {
+	if (metrics->format == STATS_NONE) {
+		return 0;
+	}
+	// user and sys time of every thread of the process, the workers included
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	double wall = (copy_now_ns() - metrics->start_ns) / 1e9;
+	double user = timeval_seconds(usage.ru_utime) - timeval_seconds(metrics->start_usage.ru_utime);
+	double sys = timeval_seconds(usage.ru_stime) - timeval_seconds(metrics->start_usage.ru_stime);
+
+	FILE* stream = stderr;
+	if (metrics->path != NULL) {
+		stream = fopen(metrics->path, "a");
+		if (stream == NULL) {
+			perror("Error in opening the stats file");
+			return OPEN_ERROR;
+		}
+	}
+	if (metrics->format == STATS_JSON) {
+		report_json(stream, prog, files, stats, wall, user, sys);
+	}
+	else {
+		report_human(stream, prog, files, stats, wall, user, sys);
+	}
+	if (metrics->path != NULL && fclose(stream) != 0) {
+		perror("Error in writing the stats file");
+		return WRITE_ERROR;
+	}
+	return 0;
+}
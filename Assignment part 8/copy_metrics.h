@@ -0,0 +1,32 @@
+#ifndef COPY_METRICS_H
+#define COPY_METRICS_H
+
+#include <sys/resource.h>	// to use struct rusage
+
+#include "copy_engine.h"	// to use struct copy_stats
+
+enum stats_format {
+	STATS_NONE = 0,
+	STATS_HUMAN,		// a few lines on stderr
+	STATS_JSON		// one JSON object per run, a line that tools can append to and parse
+};
+
+// --stats: what a whole cp/mv run did, measured from metrics_start to metrics_report
+struct copy_metrics {
+	enum stats_format format;
+	const char* path;	// --stats-file: append there instead of writing to stderr
+	unsigned long long start_ns;
+	struct rusage start_usage;
+};
+
+// handle --stats, --stats=human|json and --stats-file=PATH (JSON unless a format was given),
+// returns 1 when arg was one of them, 0 when it isn't and ARGUMENT_ERROR when its value is wrong
+int metrics_parse_option(const char* prog, const char* arg, struct copy_metrics* metrics);
+
+void metrics_start(struct copy_metrics* metrics);
+
+// report bytes, strategy, syscalls by kind, wall/user/sys time, throughput and the histogram
+// of the write latencies of stats (the sum over files), 0 or OPEN_ERROR/WRITE_ERROR
+int metrics_report(const struct copy_metrics* metrics, const char* prog, unsigned long long files, const struct copy_stats* stats);
+
+#endif
@@ -0,0 +1,222 @@
+#define _GNU_SOURCE		// to use copy_file_range, fallocate
+#include <pthread.h>		// to use pthread_create, pthread_join
+#include <unistd.h>		// to use pread, pwrite, lseek, ftruncate, sysconf, copy_file_range
+#include <fcntl.h>		// to use fallocate, posix_fadvise
+#include <sys/stat.h>		// to use fstat
+#include <stdlib.h>		// to use posix_memalign, free
+#include <stdio.h>		// to use perror
+#include <errno.h>		// to use errno
+
+#include "copy_engine.h"
+
+#define MAX_THREADS    64
+#define PWRITE_BUF     (1 << 20)	// per thread buffer once copy_file_range isn't available
+
+// shared by the threads copying one file, every thread takes the next chunk index
+// until none is left, so a slow chunk never keeps the others waiting
+struct chunk_job {
+	int fd_src;
+	int fd_dest;
+	off_t src_base;
+	off_t dest_base;
+	off_t size;
+	off_t chunk_size;
+	long num_chunks;
+	long next_chunk;	// taken with __atomic_fetch_add
+	int use_pwrite;		// set once copy_file_range turned out unsupported
+	int error;		// first error, makes the other threads stop
+	int error_errno;	// errno of that error, errno itself belongs to the thread
+};
+
+struct chunk_worker {
+	pthread_t thread;
+	struct chunk_job* job;
+	struct copy_stats stats;
+};
+
+
+static int copy_chunk_with_file_range(struct chunk_job* job, off_t offset, off_t len, struct copy_stats* stats) {
+	loff_t off_src = job->src_base + offset;
+	loff_t off_dest = job->dest_base + offset;
+	while (len > 0) {
+		unsigned long long start = copy_now_ns();
+		ssize_t num_bytes = copy_file_range(job->fd_src, &off_src, job->fd_dest, &off_dest, len, 0);
+		if (num_bytes < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return WRITE_ERROR;
+		}
+		if (num_bytes == 0) {
+			break; // the source shrank meanwhile
+		}
+		copy_count_write(stats, CALL_COPY_FILE_RANGE, start);
+		stats->strategy = COPY_FILE_RANGE;
+		stats->bytes += num_bytes;
+		len -= num_bytes;
+	}
+	return 0;
+}
+
+static int copy_chunk_with_pwrite(struct chunk_job* job, off_t offset, off_t len, char* buf, struct copy_stats* stats) {
+	while (len > 0) {
+		ssize_t num_bytes_read = pread(job->fd_src, buf, len < PWRITE_BUF ? len : PWRITE_BUF, job->src_base + offset);
+		if (num_bytes_read < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return READ_ERROR;
+		}
+		copy_count_call(stats, CALL_PREAD);
+		if (num_bytes_read == 0) {
+			break;
+		}
+		for (ssize_t done = 0; done < num_bytes_read; ) {
+			unsigned long long start = copy_now_ns();
+			ssize_t num_bytes_written = pwrite(job->fd_dest, buf + done, num_bytes_read - done, job->dest_base + offset + done);
+			if (num_bytes_written < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return WRITE_ERROR;
+			}
+			copy_count_write(stats, CALL_PWRITE, start);
+			done += num_bytes_written;
+		}
+		stats->strategy = COPY_READ_WRITE;
+		stats->bytes += num_bytes_read;
+		offset += num_bytes_read;
+		len -= num_bytes_read;
+	}
+	return 0;
+}
+
+static void* chunk_worker_run(void* arg) {
+	struct chunk_worker* worker = arg;
+	struct chunk_job* job = worker->job;
+	char* buf = NULL;
+
+	while (__atomic_load_n(&job->error, __ATOMIC_RELAXED) == 0) {
+		long chunk = __atomic_fetch_add(&job->next_chunk, 1, __ATOMIC_RELAXED);
+		if (chunk >= job->num_chunks) {
+			break;
+		}
+		off_t offset = chunk * job->chunk_size;
+		off_t len = job->size - offset < job->chunk_size ? job->size - offset : job->chunk_size;
+
+		int ret = -1;
+		if (!__atomic_load_n(&job->use_pwrite, __ATOMIC_RELAXED)) {
+			ret = copy_chunk_with_file_range(job, offset, len, &worker->stats);
+			if (ret < 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP)) {
+				// the whole chunk is redone below with pread/pwrite, rewriting a part is harmless
+				__atomic_store_n(&job->use_pwrite, 1, __ATOMIC_RELAXED);
+			}
+		}
+		if (__atomic_load_n(&job->use_pwrite, __ATOMIC_RELAXED) && ret < 0) {
+			if (buf == NULL && posix_memalign((void**)&buf, sysconf(_SC_PAGESIZE), PWRITE_BUF) != 0) {
+				ret = MALLOC_ERROR;
+			}
+			else {
+				ret = copy_chunk_with_pwrite(job, offset, len, buf, &worker->stats);
+			}
+		}
+		if (ret < 0) {
+			int err = errno;
+			int no_error = 0;
+			if (__atomic_compare_exchange_n(&job->error, &no_error, ret, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				job->error_errno = err;
+			}
+			break;
+		}
+	}
+	free(buf);
+	return NULL;
+}
+
+
+int copy_fd_parallel(int fd_src, int fd_dest, off_t size, const struct copy_options* opts, struct copy_stats* stats) {
+	struct chunk_job job = {0};
+	job.fd_src = fd_src;
+	job.fd_dest = fd_dest;
+	job.src_base = lseek(fd_src, 0, SEEK_CUR);
+	job.dest_base = lseek(fd_dest, 0, SEEK_CUR);
+	if (job.src_base < 0 || job.dest_base < 0) {
+		perror("Error in getting the file offsets");
+		return SEEK_ERROR;
+	}
+	job.size = size - job.src_base;
+	job.chunk_size = opts->chunk_size > 0 ? opts->chunk_size : DEFAULT_CHUNK_SIZE;
+	job.num_chunks = (job.size + job.chunk_size - 1) / job.chunk_size;
+
+	// reserve the whole destination up front, the chunks land in any order
+	// and the file system can still lay it out contiguously, but never over the holes
+	// of a sparse source or the ones --sparse asks for
+	struct stat st;
+	int has_holes = fstat(fd_src, &st) == 0 && (off_t)st.st_blocks * 512 < st.st_size;
+	int keep_holes = opts->sparse == SPARSE_ALWAYS || (has_holes && opts->sparse != SPARSE_NEVER);
+	if (!keep_holes && fallocate(fd_dest, 0, job.dest_base, job.size) < 0 && ftruncate(fd_dest, job.dest_base + job.size) < 0) {
+		perror("Error in preallocating destination file");
+		return TRUNCATE_ERROR;
+	}
+	posix_fadvise(fd_src, job.src_base, job.size, POSIX_FADV_SEQUENTIAL);
+
+	int num_threads = opts->threads > 0 ? opts->threads : sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_threads > MAX_THREADS) {
+		num_threads = MAX_THREADS;
+	}
+	if (num_threads > job.num_chunks) {
+		num_threads = job.num_chunks;
+	}
+	if (num_threads < 1) {
+		num_threads = 1;
+	}
+
+	struct chunk_worker workers[MAX_THREADS] = {0};
+	int started = 0;
+	for (int i = 0; i < num_threads; i++) {
+		workers[i].job = &job;
+		if (pthread_create(&workers[i].thread, NULL, chunk_worker_run, &workers[i]) != 0) {
+			break;
+		}
+		started++;
+	}
+	if (started == 0) {
+		// no thread at all, this one does the work
+		workers[0].job = &job;
+		chunk_worker_run(&workers[0]);
+	}
+	for (int i = 0; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+
+	// the chunks finish in any order, --verify has to hash the source again
+	stats->checksummed = 0;
+	stats->threads = started > 0 ? started : 1;
+	for (int i = 0; i < stats->threads; i++) {
+		copy_stats_add(stats, &workers[i].stats);
+	}
+	if (job.error < 0) {
+		errno = job.error_errno;
+		perror("Error in copying a chunk");
+		return job.error;
+	}
+
+	// the destination ends where the source ends now: what was preallocated past the end
+	// of a source that shrank meanwhile goes away, and a hole at the end gets its size
+	off_t copied = job.size;
+	if (fstat(fd_src, &st) == 0 && st.st_size - job.src_base < copied) {
+		copied = st.st_size > job.src_base ? st.st_size - job.src_base : 0;
+	}
+	if (ftruncate(fd_dest, job.dest_base + copied) < 0) {
+		perror("Error in setting the size of destination file");
+		return TRUNCATE_ERROR;
+	}
+	copy_count_call(stats, CALL_TRUNCATE);
+
+	// leave the offsets at the end like the other strategies do
+	if (lseek(fd_src, job.src_base + copied, SEEK_SET) < 0 || lseek(fd_dest, job.dest_base + copied, SEEK_SET) < 0) {
+		perror("Error in seeking to the end of the copy");
+		return SEEK_ERROR;
+	}
+	return 0;
+}
@@ -0,0 +1,176 @@
+#define _GNU_SOURCE		// to use posix_memalign, posix_fadvise, clock_gettime
+#include <pthread.h>		// to use pthread_create, pthread_join, pthread_mutex_*, pthread_cond_*
+#include <unistd.h>		// to use read, write, sysconf
+#include <fcntl.h>		// to use posix_fadvise
+#include <stdlib.h>		// to use posix_memalign, free
+#include <stdio.h>		// to use perror
+#include <errno.h>		// to use errno
+#include <time.h>		// to use clock_gettime
+
+#include "copy_engine.h"
+#include "copy_checksum.h"	// to use crc32c
+
+#define PIPELINE_SLOTS 8
+#define PIPELINE_BUF   (1 << 20)
+
+// ring of buffers between the reader thread and the writer (the calling thread):
+// slots [consumed, produced) are full, the others are free
+struct pipeline {
+	int fd_src;
+	int fd_dest;
+	char* bufs;
+	ssize_t len[PIPELINE_SLOTS];	// bytes in a full slot, 0 for EOF, -1 for a read error
+	int read_errno;
+	unsigned long produced;
+	unsigned long consumed;
+	int stop;			// the writer failed, the reader has to quit
+	pthread_mutex_t lock;
+	pthread_cond_t not_full;
+	pthread_cond_t not_empty;
+	unsigned long long read_calls;
+	unsigned long long read_stall_ns;
+	unsigned long long write_stall_ns;
+};
+
+
+static unsigned long long now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void* pipeline_reader(void* arg) {
+	struct pipeline* p = arg;
+	while (1) {
+		pthread_mutex_lock(&p->lock);
+		if (p->produced - p->consumed == PIPELINE_SLOTS && !p->stop) {
+			// every buffer is waiting for the writer, the destination is the slow side
+			unsigned long long start = now_ns();
+			while (p->produced - p->consumed == PIPELINE_SLOTS && !p->stop) {
+				pthread_cond_wait(&p->not_full, &p->lock);
+			}
+			p->read_stall_ns += now_ns() - start;
+		}
+		int stop = p->stop;
+		pthread_mutex_unlock(&p->lock);
+		if (stop) {
+			break;
+		}
+
+		int slot = p->produced % PIPELINE_SLOTS;
+		ssize_t num_bytes_read;
+		do {
+			num_bytes_read = read(p->fd_src, p->bufs + (size_t)slot * PIPELINE_BUF, PIPELINE_BUF);
+		}
+		while (num_bytes_read < 0 && errno == EINTR);
+		if (num_bytes_read < 0) {
+			p->read_errno = errno;
+		}
+
+		pthread_mutex_lock(&p->lock);
+		p->read_calls++;
+		p->len[slot] = num_bytes_read;
+		p->produced++;
+		pthread_cond_signal(&p->not_empty);
+		pthread_mutex_unlock(&p->lock);
+		if (num_bytes_read <= 0) {
+			break;
+		}
+	}
+	return NULL;
+}
+
+
+int copy_fd_pipeline(int fd_src, int fd_dest, struct copy_stats* stats) {
+	struct pipeline p = {0};
+	p.fd_src = fd_src;
+	p.fd_dest = fd_dest;
+	if (posix_memalign((void**)&p.bufs, sysconf(_SC_PAGESIZE), (size_t)PIPELINE_SLOTS * PIPELINE_BUF) != 0) {
+		perror("Unable to allocate the pipeline buffers");
+		return MALLOC_ERROR;
+	}
+	pthread_mutex_init(&p.lock, NULL);
+	pthread_cond_init(&p.not_full, NULL);
+	pthread_cond_init(&p.not_empty, NULL);
+	posix_fadvise(fd_src, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	pthread_t reader;
+	if (pthread_create(&reader, NULL, pipeline_reader, &p) != 0) {
+		perror("Error in creating the reader thread");
+		free(p.bufs);
+		return THREAD_ERROR;
+	}
+
+	int ret = 0;
+	while (1) {
+		pthread_mutex_lock(&p.lock);
+		if (p.produced == p.consumed) {
+			// nothing to write yet, the source is the slow side
+			unsigned long long start = now_ns();
+			while (p.produced == p.consumed) {
+				pthread_cond_wait(&p.not_empty, &p.lock);
+			}
+			p.write_stall_ns += now_ns() - start;
+		}
+		pthread_mutex_unlock(&p.lock);
+
+		int slot = p.consumed % PIPELINE_SLOTS;
+		ssize_t len = p.len[slot];
+		if (len < 0) {
+			errno = p.read_errno;
+			perror("Error in reading from source file");
+			ret = READ_ERROR;
+			break;
+		}
+		if (len == 0) {
+			break;
+		}
+
+		char* buf = p.bufs + (size_t)slot * PIPELINE_BUF;
+		if (stats->checksummed) {
+			stats->checksum = crc32c(stats->checksum, buf, len);
+		}
+		for (ssize_t done = 0; done < len; ) {
+			unsigned long long start = copy_now_ns();
+			ssize_t num_bytes_written = write(fd_dest, buf + done, len - done);
+			if (num_bytes_written < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				perror("Error in writing to destination file");
+				ret = WRITE_ERROR;
+				break;
+			}
+			copy_count_write(stats, CALL_WRITE, start);
+			done += num_bytes_written;
+		}
+		if (ret < 0) {
+			break;
+		}
+		stats->bytes += len;
+
+		pthread_mutex_lock(&p.lock);
+		p.consumed++;
+		pthread_cond_signal(&p.not_full);
+		pthread_mutex_unlock(&p.lock);
+	}
+
+	pthread_mutex_lock(&p.lock);
+	p.stop = 1;
+	pthread_cond_signal(&p.not_full);
+	pthread_mutex_unlock(&p.lock);
+	pthread_join(reader, NULL);
+
+	stats->strategy = COPY_PIPELINE;
+	stats->calls += p.read_calls;
+	stats->calls_by_kind[CALL_READ] += p.read_calls;
+	stats->threads = 2;
+	stats->read_stall_ns = p.read_stall_ns;
+	stats->write_stall_ns = p.write_stall_ns;
+
+	pthread_mutex_destroy(&p.lock);
+	pthread_cond_destroy(&p.not_full);
+	pthread_cond_destroy(&p.not_empty);
+	free(p.bufs);
+	return ret;
+}
@@ -0,0 +1,235 @@
+#define _GNU_SOURCE		// to use getdents64, struct dirent64
+#include <pthread.h>		// to use pthread_create, pthread_join, pthread_mutex_*, pthread_cond_*
+#include <dirent.h>		// to use getdents64, DT_*
+#include <fcntl.h>		// to use openat, AT_FDCWD, AT_REMOVEDIR, O_DIRECTORY, O_NOFOLLOW
+#include <sys/stat.h>		// to use fstatat
+#include <unistd.h>		// to use close, unlinkat, sysconf
+#include <stdlib.h>		// to use malloc, free
+#include <string.h>		// to use strlen, strcmp, strcpy, strerror
+#include <stdio.h>		// to use fprintf, snprintf
+#include <errno.h>		// to use errno
+#include <limits.h>		// to use PATH_MAX
+
+#include "copy_remove.h"
+
+#define DENTS_SIZE  32768
+#define MAX_THREADS 64
+#define MIN_THREADS 4		// unlinks wait on the file system journal more than on the CPU
+
+// a directory to empty and remove, it stays open while something under it is still there
+struct rm_dir {
+	struct rm_dir* parent;	// NULL for the top directory
+	struct rm_dir* next;	// in the stack of directories waiting for a worker
+	int fd;
+	int pending;		// its own scan + its subdirectories not removed yet (under the lock)
+	char* path;		// for messages, name is its last component
+	char* name;
+};
+
+struct tree_remover {
+	const char* prog;
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	struct rm_dir* stack;	// LIFO so the walk stays depth first and few directories are open
+	int done;		// the top directory is gone (or failed)
+	int error;
+	unsigned long long removed;
+};
+
+
+static void remove_error(struct tree_remover* tr, int code, const char* path) {
+	int err = errno;
+	fprintf(stderr, "%s: cannot remove '%s': %s\n", tr->prog, path, strerror(err));
+	pthread_mutex_lock(&tr->lock);
+	if (tr->error == 0) {
+		tr->error = code;
+	}
+	pthread_mutex_unlock(&tr->lock);
+}
+
+static struct rm_dir* new_rm_dir(struct rm_dir* parent, const char* name) {
+	char path[PATH_MAX];
+	if (parent == NULL) {
+		snprintf(path, sizeof(path), "%s", name);
+	}
+	else {
+		snprintf(path, sizeof(path), "%s/%s", parent->path, name);
+	}
+	size_t path_len = strlen(path) + 1;
+	size_t name_len = strlen(name) + 1;
+	struct rm_dir* dir = malloc(sizeof(struct rm_dir) + path_len + name_len);
+	if (dir == NULL) {
+		return NULL;
+	}
+	dir->parent = parent;
+	dir->next = NULL;
+	dir->fd = -1;
+	dir->pending = 1;
+	dir->path = (char*)(dir + 1);
+	dir->name = dir->path + path_len;
+	strcpy(dir->path, path);
+	strcpy(dir->name, name);
+	return dir;
+}
+
+static void push_dir(struct tree_remover* tr, struct rm_dir* dir) {
+	pthread_mutex_lock(&tr->lock);
+	dir->next = tr->stack;
+	tr->stack = dir;
+	pthread_cond_signal(&tr->not_empty);
+	pthread_mutex_unlock(&tr->lock);
+}
+
+// one part of dir is finished, the last one removes it and goes on with its parent
+static void finish_part(struct tree_remover* tr, struct rm_dir* dir) {
+	while (dir != NULL) {
+		pthread_mutex_lock(&tr->lock);
+		int last = (--dir->pending == 0);
+		pthread_mutex_unlock(&tr->lock);
+		if (!last) {
+			return;
+		}
+
+		struct rm_dir* parent = dir->parent;
+		if (dir->fd >= 0) {
+			close(dir->fd);
+		}
+		if (unlinkat(parent != NULL ? parent->fd : AT_FDCWD, dir->name, AT_REMOVEDIR) < 0) {
+			remove_error(tr, UNLINK_ERROR, dir->path);
+		}
+		else {
+			__atomic_fetch_add(&tr->removed, 1, __ATOMIC_RELAXED);
+		}
+		if (parent == NULL) {
+			pthread_mutex_lock(&tr->lock);
+			tr->done = 1;
+			pthread_cond_broadcast(&tr->not_empty);
+			pthread_mutex_unlock(&tr->lock);
+		}
+		free(dir);
+		dir = parent;
+	}
+}
+
+// unlink everything in dir that isn't a directory, hand the subdirectories to the pool
+static void empty_dir(struct tree_remover* tr, struct rm_dir* dir, char* buf) {
+	int parent_fd = dir->parent != NULL ? dir->parent->fd : AT_FDCWD;
+	dir->fd = openat(parent_fd, dir->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (dir->fd < 0) {
+		remove_error(tr, OPEN_ERROR, dir->path);
+		return;
+	}
+
+	ssize_t num_bytes;
+	while ((num_bytes = getdents64(dir->fd, buf, DENTS_SIZE)) > 0) {
+		for (ssize_t off = 0; off < num_bytes; ) {
+			struct dirent64* entry = (struct dirent64*)(buf + off);
+			off += entry->d_reclen;
+			const char* name = entry->d_name;
+			if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+				continue;
+			}
+
+			unsigned char type = entry->d_type;
+			struct stat st;
+			if (type == DT_UNKNOWN && fstatat(dir->fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+				type = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+			}
+			if (type == DT_DIR) {
+				struct rm_dir* child = new_rm_dir(dir, name);
+				if (child == NULL) {
+					errno = ENOMEM;
+					remove_error(tr, MALLOC_ERROR, dir->path);
+					continue;
+				}
+				pthread_mutex_lock(&tr->lock);
+				dir->pending++;
+				pthread_mutex_unlock(&tr->lock);
+				push_dir(tr, child);
+			}
+			else if (unlinkat(dir->fd, name, 0) < 0) {
+				char path[PATH_MAX];
+				snprintf(path, sizeof(path), "%s/%s", dir->path, name);
+				remove_error(tr, UNLINK_ERROR, path);
+			}
+			else {
+				__atomic_fetch_add(&tr->removed, 1, __ATOMIC_RELAXED);
+			}
+		}
+	}
+	if (num_bytes < 0) {
+		remove_error(tr, READ_ERROR, dir->path);
+	}
+}
+
+static void* remove_worker(void* arg) {
+	struct tree_remover* tr = arg;
+	char* buf = malloc(DENTS_SIZE);
+	if (buf == NULL) {
+		return NULL;
+	}
+	while (1) {
+		pthread_mutex_lock(&tr->lock);
+		while (tr->stack == NULL && !tr->done) {
+			pthread_cond_wait(&tr->not_empty, &tr->lock);
+		}
+		struct rm_dir* dir = tr->stack;
+		if (dir == NULL) {
+			pthread_mutex_unlock(&tr->lock);
+			break;
+		}
+		tr->stack = dir->next;
+		pthread_mutex_unlock(&tr->lock);
+
+		empty_dir(tr, dir, buf);
+		finish_part(tr, dir);
+	}
+	free(buf);
+	return NULL;
+}
+
+
+int tree_remove(const char* prog, const char* path, int threads, unsigned long long* removed) {
+	struct tree_remover tr = {0};
+	tr.prog = prog;
+	pthread_mutex_init(&tr.lock, NULL);
+	pthread_cond_init(&tr.not_empty, NULL);
+
+	struct rm_dir* top = new_rm_dir(NULL, path);
+	if (top == NULL) {
+		perror("Unable to allocate memory");
+		return MALLOC_ERROR;
+	}
+	tr.stack = top;
+
+	if (threads <= 0) {
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (threads < MIN_THREADS) {
+			threads = MIN_THREADS;
+		}
+	}
+	if (threads > MAX_THREADS) {
+		threads = MAX_THREADS;
+	}
+	pthread_t workers[MAX_THREADS];
+	int started = 0;
+	for (int i = 0; i < threads; i++) {
+		if (pthread_create(&workers[i], NULL, remove_worker, &tr) != 0) {
+			break;
+		}
+		started++;
+	}
+	if (started == 0) {
+		remove_worker(&tr);
+	}
+	for (int i = 0; i < started; i++) {
+		pthread_join(workers[i], NULL);
+	}
+
+	pthread_mutex_destroy(&tr.lock);
+	pthread_cond_destroy(&tr.not_empty);
+	if (removed != NULL) {
+		*removed = tr.removed;
+	}
+	return tr.error;
+}
@@ -0,0 +1,13 @@
+#ifndef COPY_REMOVE_H
+#define COPY_REMOVE_H
+
+#include "copy_engine.h"	// to use the error codes
+
+// remove the directory path and everything under it (like rm -r) from threads workers
+// (0 picks a number from the CPU count): every worker empties a whole directory with
+// unlinkat, its subdirectories go back to the pool, and a directory is removed by whoever
+// finishes its last subdirectory, removed counts the entries that are gone
+// returns 0 or the first error (every failure is printed as "<prog>: cannot remove ...")
+int tree_remove(const char* prog, const char* path, int threads, unsigned long long* removed);
+
+#endif
@@ -0,0 +1,123 @@
+#define _GNU_SOURCE		// to use sync_file_range, syncfs
+#include <fcntl.h>		// to use open, sync_file_range, SYNC_FILE_RANGE_*
+#include <unistd.h>		// to use close, fdatasync, syncfs
+#include <string.h>		// to use strcmp, strncmp
+#include <stdio.h>		// to use perror, fprintf
+#include <errno.h>		// to use errno
+
+#include "copy_sync.h"
+
+
+int sync_parse_option(const char* prog, const char* arg, struct copy_options* opts) {
+	if (strncmp(arg, "--sync=", 7) != 0) {
+		return 0;
+	}
+	const char* policy = arg + 7;
+	if (strcmp(policy, "none") == 0) {
+		opts->sync = SYNC_NONE;
+	}
+	else if (strcmp(policy, "file") == 0) {
+		opts->sync = SYNC_FILE;
+	}
+	else if (strcmp(policy, "batch") == 0) {
+		opts->sync = SYNC_BATCH;
+	}
+	else if (strcmp(policy, "fs") == 0) {
+		opts->sync = SYNC_FS;
+	}
+	else {
+		fprintf(stderr, "%s: invalid argument '%s' for '--sync'\n", prog, policy);
+		return ARGUMENT_ERROR;
+	}
+	return 1;
+}
+
+
+int sync_written(int fd, enum sync_policy policy, struct copy_stats* stats) {
+	if (policy == SYNC_FILE) {
+		if (fdatasync(fd) < 0 && errno != EINVAL) {
+			perror("Error in flushing destination file");
+			return WRITE_ERROR;
+		}
+		copy_count_call(stats, CALL_SYNC);
+	}
+	else if (policy == SYNC_BATCH) {
+		// only queues the dirty pages for writeback, doesn't wait
+		if (sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE) < 0 && errno != EINVAL && errno != ESPIPE) {
+			perror("Error in flushing destination file");
+			return WRITE_ERROR;
+		}
+		copy_count_call(stats, CALL_SYNC);
+	}
+	return 0;
+}
+
+int sync_wait(const int* fds, int count, struct copy_stats* stats) {
+	for (int i = 0; i < count; i++) {
+		if (sync_file_range(fds[i], 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER) < 0
+			&& errno != EINVAL && errno != ESPIPE) {
+			perror("Error in flushing destination file");
+			return WRITE_ERROR;
+		}
+		copy_count_call(stats, CALL_SYNC);
+	}
+	// sync_file_range writes the data but neither i_size, the block allocation nor the disk
+	// cache, and one fdatasync doesn't commit the other files on every file system (btrfs,
+	// ext4 fast_commit), so each file gets its own: the data is already on disk, they're short
+	for (int i = 0; i < count; i++) {
+		if (fdatasync(fds[i]) < 0 && errno != EINVAL) {
+			perror("Error in flushing destination file");
+			return WRITE_ERROR;
+		}
+		copy_count_call(stats, CALL_SYNC);
+	}
+	return 0;
+}
+
+
+int sync_close(int fd, const struct copy_options* opts, struct sync_batch* batch, struct copy_stats* stats) {
+	int ret = sync_written(fd, opts->sync, stats);
+	if (ret == 0 && opts->sync == SYNC_BATCH) {
+		batch->fds[batch->count++] = fd;
+		if (batch->count == SYNC_BATCH_FILES) {
+			return sync_flush(batch, stats);
+		}
+		return 0;
+	}
+	if (close(fd) < 0 && ret == 0) {
+		perror("Error in closing destination file descriptor");
+		ret = CLOSE_ERROR;
+	}
+	return ret;
+}
+
+int sync_flush(struct sync_batch* batch, struct copy_stats* stats) {
+	int ret = sync_wait(batch->fds, batch->count, stats);
+	for (int i = 0; i < batch->count; i++) {
+		if (close(batch->fds[i]) < 0 && ret == 0) {
+			perror("Error in closing destination file descriptor");
+			ret = CLOSE_ERROR;
+		}
+	}
+	batch->count = 0;
+	return ret;
+}
+
+
+int sync_fs(const char* path, struct copy_stats* stats) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+	if (fd < 0) {
+		perror("Error in opening destination for syncfs");
+		return OPEN_ERROR;
+	}
+	int ret = 0;
+	if (syncfs(fd) < 0) {
+		perror("Error in flushing the destination file system");
+		ret = WRITE_ERROR;
+	}
+	else {
+		copy_count_call(stats, CALL_SYNC);
+	}
+	close(fd);
+	return ret;
+}
@@ -0,0 +1,35 @@
+#ifndef COPY_SYNC_H
+#define COPY_SYNC_H
+
+#include "copy_engine.h"	// to use struct copy_options, struct copy_stats, enum sync_policy
+
+#define SYNC_BATCH_FILES 32	// --sync=batch: files whose writeback runs together before one wait
+
+// destination files of --sync=batch whose writeback was started and that are
+// still open, every thread copying files keeps its own
+struct sync_batch {
+	int fds[SYNC_BATCH_FILES];
+	int count;
+};
+
+// handle --sync=none|file|batch|fs, returns 1 when arg was one of them,
+// 0 when it isn't and ARGUMENT_ERROR when its value is wrong
+int sync_parse_option(const char* prog, const char* arg, struct copy_options* opts);
+
+// the data of fd is all written: file fdatasyncs it now, batch only starts its
+// writeback (sync_file_range) so that the disk works on it while the next files are copied
+int sync_written(int fd, enum sync_policy policy, struct copy_stats* stats);
+
+// wait for the writeback started by sync_written on count files, then fdatasync each
+// of them for its metadata and the disk cache, the data itself is already written
+int sync_wait(const int* fds, int count, struct copy_stats* stats);
+
+// close a copied destination file as opts->sync asks: with batch the fd is kept in
+// batch and closed by the sync_flush that happens when SYNC_BATCH_FILES are waiting
+int sync_close(int fd, const struct copy_options* opts, struct sync_batch* batch, struct copy_stats* stats);
+int sync_flush(struct sync_batch* batch, struct copy_stats* stats);
+
+// --sync=fs: a single syncfs of the file system that holds path, once everything is copied
+int sync_fs(const char* path, struct copy_stats* stats);
+
+#endif
@@ -0,0 +1,646 @@
+#define _GNU_SOURCE		// to use getdents64, struct dirent64
+#include <pthread.h>		// to use pthread_create, pthread_join, pthread_mutex_*, pthread_cond_*
+#include <dirent.h>		// to use getdents64, DT_*
+#include <fcntl.h>		// to use openat, AT_FDCWD, O_DIRECTORY, O_NOFOLLOW
+#include <sys/stat.h>		// to use fstat, fstatat, mkdirat, mknodat, fchmod, umask
+#include <unistd.h>		// to use close, readlinkat, symlinkat, sysconf
+#include <stdlib.h>		// to use malloc, calloc, free
+#include <string.h>		// to use strlen, strcmp, strcpy, strerror
+#include <stdio.h>		// to use fprintf, snprintf
+#include <errno.h>		// to use errno
+#include <limits.h>		// to use PATH_MAX, NAME_MAX
+
+#include "copy_tree.h"
+#include "copy_uring.h"
+#include "copy_sync.h"		// to use sync_close, sync_flush
+#include "copy_links.h"		// to use link_map_*
+
+#define QUEUE_SIZE  256		// queued files, every queued file keeps its directories open
+#define DENTS_SIZE  32768	// bytes of directory entries read per getdents64
+#define MAX_THREADS 64
+#define MIN_THREADS 4		// small files wait on the disk more than on the CPU
+
+
+// a directory being copied, the queued files refer to it by fd so that nothing
+// has to resolve a full path again, it is closed when its last file is done
+struct tree_dir {
+	int src_fd;
+	int dest_fd;
+	int is_root;		// fds belong to the caller (AT_FDCWD / target directory)
+	mode_t mode;		// given to the destination at the end when the creation mode differed
+	int created;		// the copy made the destination, an existing one keeps its own mode
+	int refs;		// the walker + every queued file (protected by the pool lock)
+	char* src_path;		// only for messages
+	char* dest_path;
+};
+
+struct tree_item {
+	struct tree_dir* dir;
+	const char* src;	// command line operand (relative to dir->src_fd), NULL to use name
+	const char* dest;	// name to create in dir->dest_fd, NULL to use name
+	char name[NAME_MAX + 1];
+};
+
+struct tree_copy {
+	const char* prog;
+	const struct copy_options* opts;
+	mode_t umask;
+
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+	struct tree_item queue[QUEUE_SIZE];
+	int head;
+	int count;
+	int closed;
+
+	int num_threads;
+	pthread_t threads[MAX_THREADS];
+
+	struct tree_totals totals;
+	int error;		// first error, 0 while everything went fine
+
+	struct link_map* links;		// hard linked sources, NULL with opts->break_links
+	pthread_cond_t link_ready;	// the first link of an inode was created (or failed)
+};
+
+
+static void join_path(char* buf, const char* dir, const char* name) {
+	if (dir[0] == '\0') {
+		snprintf(buf, PATH_MAX, "%s", name);
+	}
+	else {
+		snprintf(buf, PATH_MAX, "%s/%s", dir, name);
+	}
+}
+
+// remember the first error, the copy goes on with the other files
+static int set_error(struct tree_copy* tc, int code) {
+	pthread_mutex_lock(&tc->lock);
+	if (tc->error == 0) {
+		tc->error = code;
+	}
+	pthread_mutex_unlock(&tc->lock);
+	return code;
+}
+
+// print "<prog>: <what> '<dir>/<name>': <strerror(errno)>"
+static int tree_error(struct tree_copy* tc, int code, const char* what, const char* dir, const char* name) {
+	char path[PATH_MAX];
+	int err = errno;
+	join_path(path, dir, name);
+	fprintf(stderr, "%s: %s '%s': %s\n", tc->prog, what, path, strerror(err));
+	return set_error(tc, code);
+}
+
+
+static struct tree_dir* new_dir(int src_fd, int dest_fd, int is_root, mode_t mode, const char* src_path, const char* dest_path) {
+	size_t src_len = strlen(src_path) + 1;
+	size_t dest_len = strlen(dest_path) + 1;
+	struct tree_dir* dir = malloc(sizeof(struct tree_dir) + src_len + dest_len);
+	if (dir == NULL) {
+		return NULL;
+	}
+	dir->src_fd = src_fd;
+	dir->dest_fd = dest_fd;
+	dir->is_root = is_root;
+	dir->mode = mode;
+	dir->created = 0;
+	dir->refs = 1;
+	dir->src_path = (char*)(dir + 1);
+	dir->dest_path = dir->src_path + src_len;
+	strcpy(dir->src_path, src_path);
+	strcpy(dir->dest_path, dest_path);
+	return dir;
+}
+
+// drop one reference, the last one fixes the mode and closes the directory
+static void release_dir(struct tree_copy* tc, struct tree_dir* dir) {
+	pthread_mutex_lock(&tc->lock);
+	int last = (--dir->refs == 0);
+	pthread_mutex_unlock(&tc->lock);
+	if (!last) {
+		return;
+	}
+
+	if (!dir->is_root) {
+		// the directory was created writable for us, now it can get the source mode
+		if (dir->created && (dir->mode & S_IRWXU) != S_IRWXU && fchmod(dir->dest_fd, dir->mode & ~tc->umask) < 0) {
+			tree_error(tc, WRITE_ERROR, "cannot set permissions of", dir->dest_path, "");
+		}
+		close(dir->src_fd);
+		close(dir->dest_fd);
+	}
+	free(dir);
+}
+
+
+// a source with several links: the first one seen is copied, the others wait until
+// its destination exists and link to it, returns 1 when dest was linked, 0 when it has
+// to be copied (*first is set when this is the first link) or a negative error code
+static int link_copy(struct tree_copy* tc, struct tree_dir* dir, const char* dest, const struct stat* st, int* first) {
+	char path[PATH_MAX];
+	pthread_mutex_lock(&tc->lock);
+	struct link_entry* entry;
+	while ((entry = link_map_find(tc->links, st->st_dev, st->st_ino)) != NULL && entry->state == LINK_COPYING) {
+		pthread_cond_wait(&tc->link_ready, &tc->lock);
+	}
+	if (entry == NULL) {
+		join_path(path, dir->dest_path, dest);
+		*first = link_map_add(tc->links, st->st_dev, st->st_ino, st->st_nlink, path) != NULL;
+		pthread_mutex_unlock(&tc->lock);
+		return 0;
+	}
+	if (entry->state == LINK_FAILED) {
+		pthread_mutex_unlock(&tc->lock);
+		return 0;
+	}
+	strcpy(path, link_map_path(tc->links, entry));
+	link_map_seen(tc->links, entry);
+	tc->totals.links++;
+	pthread_mutex_unlock(&tc->lock);
+
+	// like the copy would, replace what the destination already has under that name
+	if (linkat(AT_FDCWD, path, dir->dest_fd, dest, 0) < 0
+		&& (errno != EEXIST || unlinkat(dir->dest_fd, dest, 0) < 0 || linkat(AT_FDCWD, path, dir->dest_fd, dest, 0) < 0)) {
+		return tree_error(tc, WRITE_ERROR, "cannot create hard link", dir->dest_path, dest);
+	}
+	if (tc->opts->verbose) {
+		char dest_path[PATH_MAX];
+		join_path(dest_path, dir->dest_path, dest);
+		fprintf(stderr, "%s: '%s' => '%s' (hard link)\n", tc->prog, dest_path, path);
+	}
+	return 1;
+}
+
+// the first link of st was created or not, let the other links go on
+static void link_created(struct tree_copy* tc, const struct stat* st, int created) {
+	pthread_mutex_lock(&tc->lock);
+	struct link_entry* entry = link_map_find(tc->links, st->st_dev, st->st_ino);
+	if (entry != NULL) {
+		entry->state = created ? LINK_READY : LINK_FAILED;
+	}
+	pthread_cond_broadcast(&tc->link_ready);
+	pthread_mutex_unlock(&tc->lock);
+}
+
+// copy one regular file, 1 when it was hard linked to an earlier copy instead
+static int copy_file_at(struct tree_copy* tc, const struct tree_item* item, struct sync_batch* sb, struct copy_stats* stats) {
+	struct tree_dir* dir = item->dir;
+	const char* src = item->src ? item->src : item->name;
+	const char* dest = item->dest ? item->dest : item->name;
+
+	int fd_src = openat(dir->src_fd, src, O_RDONLY | O_CLOEXEC | (item->src ? 0 : O_NOFOLLOW));
+	if (fd_src < 0) {
+		return tree_error(tc, OPEN_ERROR, "cannot open", dir->src_path, src);
+	}
+	struct stat st;
+	if (fstat(fd_src, &st) < 0) {
+		close(fd_src);
+		return tree_error(tc, OPEN_ERROR, "cannot stat", dir->src_path, src);
+	}
+
+	int first_link = 0;
+	if (st.st_nlink > 1 && tc->links != NULL) {
+		int linked = link_copy(tc, dir, dest, &st, &first_link);
+		if (linked != 0) {
+			close(fd_src);
+			return linked;
+		}
+	}
+
+	// --delta compares with what the destination has, so it has to stay and be readable
+	int flags = tc->opts->delta ? O_RDWR : O_WRONLY | O_TRUNC;
+	int fd_dest = openat(dir->dest_fd, dest, flags | O_CREAT | O_CLOEXEC, st.st_mode & 07777);
+	if (first_link) {
+		// the name exists, the other links can point to it while the data is copied
+		link_created(tc, &st, fd_dest >= 0);
+	}
+	if (fd_dest < 0) {
+		close(fd_src);
+		return tree_error(tc, OPEN_ERROR, "cannot create regular file", dir->dest_path, dest);
+	}
+
+	int ret = copy_fd(fd_src, fd_dest, tc->opts, stats);
+	if (ret < 0) {
+		tree_error(tc, ret, "error copying", dir->src_path, src);
+	}
+	close(fd_src);
+	if (ret < 0) {
+		close(fd_dest);
+	}
+	else if ((ret = sync_close(fd_dest, tc->opts, sb, stats)) < 0) {
+		tree_error(tc, ret, "error closing", dir->dest_path, dest);
+	}
+
+	if (ret == 0 && tc->opts->verbose) {
+		char src_path[PATH_MAX];
+		char dest_path[PATH_MAX];
+		join_path(src_path, dir->src_path, src);
+		join_path(dest_path, dir->dest_path, dest);
+		copy_report(stderr, tc->prog, src_path, dest_path, stats);
+	}
+	return ret;
+}
+
+// add the stats of a copied file to the totals
+static void add_file(struct tree_copy* tc, const struct copy_stats* stats) {
+	pthread_mutex_lock(&tc->lock);
+	copy_stats_add(&tc->totals.stats, stats);
+	tc->totals.files++;
+	pthread_mutex_unlock(&tc->lock);
+}
+
+// hand a batch of small files to io_uring, whatever it couldn't do is copied with copy_file_at
+// returns -1 when the ring failed: it is closed before anything is redone, and the worker
+// copies the rest of its files with copy_fd
+static int copy_batch(struct tree_copy* tc, struct uring_copy* uc, const struct tree_item* items, int count, struct sync_batch* sb) {
+	struct uring_file files[URING_BATCH];
+	for (int i = 0; i < count; i++) {
+		files[i].src_dirfd = items[i].dir->src_fd;
+		files[i].src = items[i].src ? items[i].src : items[i].name;
+		files[i].follow = items[i].src != NULL;
+		files[i].dest_dirfd = items[i].dir->dest_fd;
+		files[i].dest = items[i].dest ? items[i].dest : items[i].name;
+	}
+	int ret = uring_copy_batch(uc, files, count);
+
+	// the calls of the whole batch are in the first file, it counts even when it failed
+	pthread_mutex_lock(&tc->lock);
+	tc->totals.stats.calls += files[0].stats.calls;
+	tc->totals.stats.calls_by_kind[CALL_URING] += files[0].stats.calls;
+	pthread_mutex_unlock(&tc->lock);
+	files[0].stats.calls = 0;
+	files[0].stats.calls_by_kind[CALL_URING] = 0;
+	if (ret < 0) {
+		uring_copy_close(uc);
+	}
+
+	for (int i = 0; i < count; i++) {
+		struct copy_stats stats;
+		if (files[i].result == NOT_SUPPORTED) {
+			if (copy_file_at(tc, &items[i], sb, &stats) == 0) {
+				add_file(tc, &stats);
+			}
+			continue;
+		}
+		if (tc->opts->verbose) {
+			char src_path[PATH_MAX];
+			char dest_path[PATH_MAX];
+			join_path(src_path, items[i].dir->src_path, files[i].src);
+			join_path(dest_path, items[i].dir->dest_path, files[i].dest);
+			copy_report(stderr, tc->prog, src_path, dest_path, &files[i].stats);
+		}
+		add_file(tc, &files[i].stats);
+	}
+	return ret;
+}
+
+// the ring only reads and writes whole files: every option that asks copy_fd for something
+// else (--verify and --delta the data, --sync=file|batch the fds, a clone that must not fall
+// back to a copy, O_DIRECT, zeros made holes, chunks, the pipeline, the page cache drops)
+// keeps the files on copy_fd, an option is never ignored
+static int uring_fits(const struct copy_options* opts) {
+	return opts->engine == ENGINE_URING && opts->verify == VERIFY_NONE && !opts->delta
+		&& opts->sync != SYNC_FILE && opts->sync != SYNC_BATCH && opts->reflink != REFLINK_ALWAYS
+		&& !opts->direct && opts->sparse != SPARSE_ALWAYS && !opts->parallel && !opts->pipeline && !opts->stream;
+}
+
+static void* worker(void* arg) {
+	struct tree_copy* tc = arg;
+
+	// a ring per worker, no locking around the submissions, and no ring at all
+	// (copy_fd for every file) when the kernel doesn't have io_uring or the options need copy_fd
+	struct uring_copy* uc = NULL;
+	if (uring_fits(tc->opts)) {
+		uc = uring_copy_open();
+	}
+	int batch = uc != NULL ? URING_BATCH : 1;
+	struct sync_batch sb;
+	sb.count = 0;
+
+	while (1) {
+		pthread_mutex_lock(&tc->lock);
+		while (tc->count == 0 && !tc->closed) {
+			pthread_cond_wait(&tc->not_empty, &tc->lock);
+		}
+		if (tc->count == 0) {
+			pthread_mutex_unlock(&tc->lock);
+			break;
+		}
+		struct tree_item items[URING_BATCH];
+		int count = 0;
+		while (count < batch && tc->count > 0) {
+			items[count++] = tc->queue[tc->head];
+			tc->head = (tc->head + 1) % QUEUE_SIZE;
+			tc->count--;
+		}
+		pthread_cond_broadcast(&tc->not_full);
+		pthread_mutex_unlock(&tc->lock);
+
+		if (uc != NULL) {
+			if (copy_batch(tc, uc, items, count, &sb) < 0) {
+				uc = NULL;
+				batch = 1;
+			}
+		}
+		else {
+			struct copy_stats stats;
+			if (copy_file_at(tc, &items[0], &sb, &stats) == 0) {
+				add_file(tc, &stats);
+			}
+		}
+		for (int i = 0; i < count; i++) {
+			release_dir(tc, items[i].dir);
+		}
+	}
+	if (uc != NULL) {
+		uring_copy_close(uc);
+	}
+
+	// the files of the last incomplete group of --sync=batch
+	struct copy_stats stats = {0};
+	if (sync_flush(&sb, &stats) < 0) {
+		set_error(tc, WRITE_ERROR);
+	}
+	pthread_mutex_lock(&tc->lock);
+	copy_stats_add(&tc->totals.stats, &stats);
+	pthread_mutex_unlock(&tc->lock);
+	return NULL;
+}
+
+// hand a regular file to the workers, waits while the queue is full
+static void enqueue_file(struct tree_copy* tc, struct tree_dir* dir, const char* name, const char* src, const char* dest) {
+	pthread_mutex_lock(&tc->lock);
+	while (tc->count == QUEUE_SIZE) {
+		pthread_cond_wait(&tc->not_full, &tc->lock);
+	}
+	struct tree_item* item = &tc->queue[(tc->head + tc->count) % QUEUE_SIZE];
+	item->dir = dir;
+	item->src = src;
+	item->dest = dest;
+	if (name != NULL) {
+		strcpy(item->name, name);
+	}
+	dir->refs++;
+	tc->count++;
+	pthread_cond_signal(&tc->not_empty);
+	pthread_mutex_unlock(&tc->lock);
+}
+
+
+static int copy_dir_at(struct tree_copy* tc, struct tree_dir* parent, const char* src, const char* dest, dev_t root_dev, ino_t root_ino);
+
+static int copy_symlink_at(struct tree_copy* tc, struct tree_dir* dir, const char* name) {
+	char target[PATH_MAX];
+	ssize_t len = readlinkat(dir->src_fd, name, target, sizeof(target) - 1);
+	if (len < 0) {
+		return tree_error(tc, READ_ERROR, "cannot read symbolic link", dir->src_path, name);
+	}
+	target[len] = '\0';
+	if (symlinkat(target, dir->dest_fd, name) < 0) {
+		return tree_error(tc, WRITE_ERROR, "cannot create symbolic link", dir->dest_path, name);
+	}
+	return 0;
+}
+
+static int copy_special_at(struct tree_copy* tc, struct tree_dir* dir, const char* name, const struct stat* st) {
+	if (S_ISSOCK(st->st_mode)) {
+		errno = EOPNOTSUPP;
+		return tree_error(tc, OPEN_ERROR, "cannot copy socket", dir->src_path, name);
+	}
+	if (mknodat(dir->dest_fd, name, st->st_mode, st->st_rdev) < 0) {
+		return tree_error(tc, WRITE_ERROR, "cannot create special file", dir->dest_path, name);
+	}
+	return 0;
+}
+
+// read the entries of dir with getdents64 and dispatch them, files go to the queue,
+// subdirectories are walked right away (depth first) by this thread
+static int walk_dir(struct tree_copy* tc, struct tree_dir* dir, dev_t root_dev, ino_t root_ino) {
+	char* buf = malloc(DENTS_SIZE);
+	if (buf == NULL) {
+		return tree_error(tc, MALLOC_ERROR, "cannot allocate memory for", dir->src_path, "");
+	}
+
+	int ret = 0;
+	ssize_t num_bytes;
+	while ((num_bytes = getdents64(dir->src_fd, buf, DENTS_SIZE)) > 0) {
+		for (ssize_t off = 0; off < num_bytes; ) {
+			struct dirent64* entry = (struct dirent64*)(buf + off);
+			off += entry->d_reclen;
+			const char* name = entry->d_name;
+			if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+				continue;
+			}
+
+			// some file systems don't fill d_type, and special files need their stat anyway
+			struct stat st;
+			unsigned char type = entry->d_type;
+			if (type != DT_REG && type != DT_DIR && type != DT_LNK) {
+				if (fstatat(dir->src_fd, name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+					ret = tree_error(tc, OPEN_ERROR, "cannot stat", dir->src_path, name);
+					continue;
+				}
+				type = S_ISREG(st.st_mode) ? DT_REG : S_ISDIR(st.st_mode) ? DT_DIR : S_ISLNK(st.st_mode) ? DT_LNK : DT_UNKNOWN;
+			}
+
+			int r = 0;
+			if (type == DT_REG) {
+				enqueue_file(tc, dir, name, NULL, NULL);
+			}
+			else if (type == DT_DIR) {
+				r = copy_dir_at(tc, dir, name, name, root_dev, root_ino);
+			}
+			else if (type == DT_LNK) {
+				r = copy_symlink_at(tc, dir, name);
+			}
+			else {
+				r = copy_special_at(tc, dir, name, &st);
+			}
+			if (r < 0) {
+				ret = r;
+			}
+			else if (type != DT_REG) {
+				pthread_mutex_lock(&tc->lock);
+				if (type == DT_DIR) {
+					tc->totals.dirs++;
+				}
+				else {
+					tc->totals.others++;
+				}
+				pthread_mutex_unlock(&tc->lock);
+			}
+		}
+	}
+	if (num_bytes < 0) {
+		ret = tree_error(tc, READ_ERROR, "cannot read directory", dir->src_path, "");
+	}
+	free(buf);
+	return ret;
+}
+
+// create dest inside parent like the directory src and copy everything under it,
+// root_dev/root_ino identify the top destination directory so it isn't copied into itself
+static int copy_dir_at(struct tree_copy* tc, struct tree_dir* parent, const char* src, const char* dest, dev_t root_dev, ino_t root_ino) {
+	int src_fd = openat(parent->src_fd, src, O_RDONLY | O_DIRECTORY | O_CLOEXEC | (parent->is_root ? 0 : O_NOFOLLOW));
+	if (src_fd < 0) {
+		return tree_error(tc, OPEN_ERROR, "cannot open directory", parent->src_path, src);
+	}
+	struct stat st;
+	if (fstat(src_fd, &st) < 0) {
+		close(src_fd);
+		return tree_error(tc, OPEN_ERROR, "cannot stat", parent->src_path, src);
+	}
+	if (st.st_dev == root_dev && st.st_ino == root_ino) {
+		char path[PATH_MAX];
+		join_path(path, parent->src_path, src);
+		fprintf(stderr, "%s: cannot copy a directory into itself, skipping '%s'\n", tc->prog, path);
+		close(src_fd);
+		return set_error(tc, ARGUMENT_ERROR);
+	}
+
+	// keep it writable and searchable for us until everything inside is copied
+	int created = mkdirat(parent->dest_fd, dest, (st.st_mode & 07777) | S_IRWXU) == 0;
+	if (!created && errno != EEXIST) {
+		close(src_fd);
+		return tree_error(tc, WRITE_ERROR, "cannot create directory", parent->dest_path, dest);
+	}
+	int dest_fd = openat(parent->dest_fd, dest, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dest_fd < 0) {
+		close(src_fd);
+		return tree_error(tc, OPEN_ERROR, "cannot open directory", parent->dest_path, dest);
+	}
+
+	char src_path[PATH_MAX];
+	char dest_path[PATH_MAX];
+	join_path(src_path, parent->src_path, src);
+	join_path(dest_path, parent->dest_path, dest);
+	struct tree_dir* dir = new_dir(src_fd, dest_fd, 0, st.st_mode & 07777, src_path, dest_path);
+	if (dir == NULL) {
+		close(src_fd);
+		close(dest_fd);
+		return tree_error(tc, MALLOC_ERROR, "cannot allocate memory for", parent->src_path, src);
+	}
+	dir->created = created;
+
+	if (root_ino == 0) {
+		// this is the top directory of the walk
+		struct stat st_dest;
+		if (fstat(dest_fd, &st_dest) == 0) {
+			root_dev = st_dest.st_dev;
+			root_ino = st_dest.st_ino;
+		}
+	}
+	int ret = walk_dir(tc, dir, root_dev, root_ino);
+	release_dir(tc, dir);
+	return ret;
+}
+
+
+struct tree_copy* tree_copy_start(const char* prog, const struct copy_options* opts) {
+	struct tree_copy* tc = calloc(1, sizeof(struct tree_copy));
+	if (tc == NULL) {
+		perror("Unable to allocate memory");
+		return NULL;
+	}
+	tc->prog = prog;
+	tc->opts = opts;
+	tc->umask = umask(0);
+	umask(tc->umask);
+	pthread_mutex_init(&tc->lock, NULL);
+	pthread_cond_init(&tc->not_empty, NULL);
+	pthread_cond_init(&tc->not_full, NULL);
+	pthread_cond_init(&tc->link_ready, NULL);
+	if (!opts->break_links) {
+		tc->links = link_map_new();
+		if (tc->links == NULL) {
+			perror("Unable to allocate memory");
+			free(tc);
+			return NULL;
+		}
+	}
+
+	int num_threads = opts->threads;
+	if (num_threads <= 0) {
+		num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (num_threads < MIN_THREADS) {
+			num_threads = MIN_THREADS;
+		}
+	}
+	if (num_threads > MAX_THREADS) {
+		num_threads = MAX_THREADS;
+	}
+	for (int i = 0; i < num_threads; i++) {
+		if (pthread_create(&tc->threads[i], NULL, worker, tc) != 0) {
+			if (i == 0) {
+				perror("Error in creating worker threads");
+				link_map_free(tc->links);
+				free(tc);
+				return NULL;
+			}
+			break; // fewer workers still do the job
+		}
+		tc->num_threads++;
+	}
+	return tc;
+}
+
+
+int tree_copy_add(struct tree_copy* tc, const char* src, int dest_dirfd, const char* dest_dir_path, const char* dest_name) {
+	struct stat st;
+	if (stat(src, &st) < 0) {
+		return tree_error(tc, OPEN_ERROR, "cannot stat", "", src);
+	}
+
+	// the operands are opened relative to the working directory, the destination relative to dest_dirfd
+	struct tree_dir* top = new_dir(AT_FDCWD, dest_dirfd, 1, 0, "", dest_dir_path);
+	if (top == NULL) {
+		return tree_error(tc, MALLOC_ERROR, "cannot allocate memory for", "", src);
+	}
+
+	int ret = 0;
+	if (S_ISDIR(st.st_mode)) {
+		if (!tc->opts->recursive) {
+			fprintf(stderr, "%s: -r not specified; omitting directory '%s'\n", tc->prog, src);
+			ret = set_error(tc, ARGUMENT_ERROR);
+		}
+		else {
+			ret = copy_dir_at(tc, top, src, dest_name, 0, 0);
+			if (ret == 0) {
+				pthread_mutex_lock(&tc->lock);
+				tc->totals.dirs++;
+				pthread_mutex_unlock(&tc->lock);
+			}
+		}
+	}
+	else {
+		enqueue_file(tc, top, NULL, src, dest_name);
+	}
+	release_dir(tc, top);
+	return ret;
+}
+
+
+int tree_copy_finish(struct tree_copy* tc, struct tree_totals* totals) {
+	pthread_mutex_lock(&tc->lock);
+	tc->closed = 1;
+	pthread_cond_broadcast(&tc->not_empty);
+	pthread_mutex_unlock(&tc->lock);
+
+	for (int i = 0; i < tc->num_threads; i++) {
+		pthread_join(tc->threads[i], NULL);
+	}
+
+	int ret = tc->error;
+	if (totals != NULL) {
+		*totals = tc->totals;
+	}
+	pthread_mutex_destroy(&tc->lock);
+	pthread_cond_destroy(&tc->not_empty);
+	pthread_cond_destroy(&tc->not_full);
+	pthread_cond_destroy(&tc->link_ready);
+	link_map_free(tc->links);
+	free(tc);
+	return ret;
+}
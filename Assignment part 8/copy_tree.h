@@ -0,0 +1,32 @@
+#ifndef COPY_TREE_H
+#define COPY_TREE_H
+
+#include "copy_engine.h"	// to use struct copy_options, struct copy_stats
+
+// a pool of worker threads copying regular files, fed by a bounded queue
+// that the caller's thread fills while it walks the source trees
+struct tree_copy;
+
+struct tree_totals {
+	struct copy_stats stats;	// sum over all copied files
+	unsigned long long files;	// regular files copied
+	unsigned long long dirs;	// directories created
+	unsigned long long others;	// symlinks and special files recreated
+	unsigned long long links;	// hard links recreated with linkat instead of copying the file again
+};
+
+// start opts->threads workers (0 picks a number from the CPU count), NULL on failure
+struct tree_copy* tree_copy_start(const char* prog, const struct copy_options* opts);
+
+// copy src to dest_name inside the directory dest_dirfd (AT_FDCWD for the working directory),
+// dest_dir_path is only used in messages ("" for the working directory)
+// a regular file is queued, a directory is walked and its content queued (needs opts->recursive)
+// files with several links are copied once, the other links found in the copy are linked to it
+// returns 0 or a negative error code, errors of the queued files are returned by tree_copy_finish
+int tree_copy_add(struct tree_copy* tc, const char* src, int dest_dirfd, const char* dest_dir_path, const char* dest_name);
+
+// wait for the queue to drain, stop the workers and free the pool,
+// returns 0 or the first error that happened while copying
+int tree_copy_finish(struct tree_copy* tc, struct tree_totals* totals);
+
+#endif
@@ -0,0 +1,373 @@
+#define _GNU_SOURCE		// to use struct statx, statx masks
+#include <linux/io_uring.h>	// to use struct io_uring_sqe, struct io_uring_cqe, IORING_*
+#include <sys/syscall.h>	// to use __NR_io_uring_setup, __NR_io_uring_enter, __NR_io_uring_register
+#include <sys/mman.h>		// to use mmap, munmap
+#include <sys/stat.h>		// to use struct statx
+#include <unistd.h>		// to use syscall, close
+#include <fcntl.h>		// to use O_*, AT_SYMLINK_NOFOLLOW
+#include <stdlib.h>		// to use calloc, posix_memalign, free
+#include <string.h>		// to use memset
+#include <errno.h>		// to use errno
+
+#include "copy_uring.h"
+
+#define URING_ENTRIES (URING_BATCH * 4)	// the longest submission is 4 SQEs per file
+#define URING_SLOTS   (URING_BATCH * 2)	// a source and a destination direct descriptor per file
+
+// steps of a file, stored in the low bits of user_data next to the file index
+enum uring_step {
+	STEP_STATX,
+	STEP_OPEN_SRC,
+	STEP_READ,
+	STEP_OPEN_DEST,
+	STEP_WRITE,
+	STEP_CLOSE
+};
+
+struct uring_copy {
+	int ring_fd;
+	void* sq_ring;
+	size_t sq_ring_size;
+	void* cq_ring;
+	size_t cq_ring_size;
+	struct io_uring_sqe* sqes;
+	size_t sqes_size;
+
+	unsigned* sq_head;
+	unsigned* sq_tail;
+	unsigned sq_mask;
+	unsigned* cq_head;
+	unsigned* cq_tail;
+	unsigned cq_mask;
+	struct io_uring_cqe* cqes;
+
+	unsigned queued;	// SQEs filled since the last submission
+	unsigned long long enters;	// io_uring_enter calls of the current batch
+	int broken;		// io_uring_enter failed, the ring isn't used anymore
+	char* bufs;		// URING_BATCH buffers of URING_FILE_MAX bytes
+	struct statx sx[URING_BATCH];
+	int failed[URING_BATCH];
+};
+
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete) {
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, IORING_ENTER_GETEVENTS, NULL, 0);
+}
+
+static struct io_uring_sqe* next_sqe(struct uring_copy* uc) {
+	unsigned tail = *uc->sq_tail + uc->queued;
+	struct io_uring_sqe* sqe = &uc->sqes[tail & uc->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	uc->queued++;
+	return sqe;
+}
+
+// a small regular file with a single link, copied by one chain
+static int fits_chain(const struct statx* sx) {
+	return S_ISREG(sx->stx_mode) && sx->stx_size <= URING_FILE_MAX && sx->stx_nlink <= 1;
+}
+
+// submit what was queued and wait for all of it, a failed step marks its file
+static int submit_and_wait(struct uring_copy* uc) {
+	unsigned expected = uc->queued;
+	__atomic_store_n(uc->sq_tail, *uc->sq_tail + uc->queued, __ATOMIC_RELEASE);
+	uc->queued = 0;
+
+	unsigned first = __atomic_load_n(uc->sq_head, __ATOMIC_ACQUIRE);
+	unsigned submitted = 0;
+	unsigned reaped = 0;
+	while (reaped < expected) {
+		int ret = uring_enter(uc->ring_fd, expected - submitted, expected - reaped);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (uc->broken) {
+				return -1; // can't even wait anymore, closing the ring is all that is left
+			}
+			// the chains the kernel already took may still be writing: take back the SQEs it
+			// didn't see and wait for the others, the caller redoes the files with nothing in flight
+			uc->broken = 1;
+			unsigned head = __atomic_load_n(uc->sq_head, __ATOMIC_ACQUIRE);
+			__atomic_store_n(uc->sq_tail, head, __ATOMIC_RELEASE);
+			expected = head - first;
+			submitted = expected;
+			continue;
+		}
+		submitted += ret;
+		uc->enters++;
+
+		unsigned head = *uc->cq_head;
+		unsigned tail = __atomic_load_n(uc->cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++, reaped++) {
+			struct io_uring_cqe* cqe = &uc->cqes[head & uc->cq_mask];
+			int i = cqe->user_data >> 3;
+			enum uring_step step = cqe->user_data & 7;
+			int res = cqe->res;
+
+			// a short read or write breaks the copy as much as an error does
+			int expected_len = (int)uc->sx[i].stx_size;
+			if (res < 0 || ((step == STEP_READ || step == STEP_WRITE) && res != expected_len)) {
+				if (step != STEP_CLOSE) {
+					uc->failed[i] = 1;
+				}
+			}
+		}
+		__atomic_store_n(uc->cq_head, head, __ATOMIC_RELEASE);
+	}
+	return uc->broken ? -1 : 0;
+}
+
+
+// submit the one SQE that was queued and take its result
+static int submit_one(struct uring_copy* uc, int* res) {
+	__atomic_store_n(uc->sq_tail, *uc->sq_tail + uc->queued, __ATOMIC_RELEASE);
+	uc->queued = 0;
+	int ret;
+	do {
+		ret = uring_enter(uc->ring_fd, 1, 1);
+	} while (ret < 0 && errno == EINTR);
+	if (ret < 0) {
+		return -1;
+	}
+	unsigned head = *uc->cq_head;
+	*res = uc->cqes[head & uc->cq_mask].res;
+	__atomic_store_n(uc->cq_head, head + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+// opening straight into a slot (file_index) needs 5.15, the probe can't tell: an older
+// kernel refuses the field (every batch would fail) or ignores it and returns a normal
+// fd that nothing closes, so /dev/null is opened into slot 0 once to see what happens
+static int direct_open_works(struct uring_copy* uc) {
+	struct io_uring_sqe* sqe = next_sqe(uc);
+	sqe->opcode = IORING_OP_OPENAT;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (unsigned long)"/dev/null";
+	sqe->open_flags = O_RDONLY;
+	sqe->file_index = 1;
+	int res;
+	if (submit_one(uc, &res) < 0) {
+		return 0;
+	}
+	if (res > 0) {
+		close(res);
+		return 0;
+	}
+	if (res < 0) {
+		return 0;
+	}
+	sqe = next_sqe(uc);
+	sqe->opcode = IORING_OP_CLOSE;
+	sqe->file_index = 1;
+	int close_res;
+	return submit_one(uc, &close_res) == 0;
+}
+
+struct uring_copy* uring_copy_open(void) {
+	struct uring_copy* uc = calloc(1, sizeof(struct uring_copy));
+	if (uc == NULL) {
+		return NULL;
+	}
+
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	uc->ring_fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+	if (uc->ring_fd < 0) {
+		free(uc);
+		return NULL;
+	}
+
+	uc->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	uc->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	uc->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	uc->sq_ring = mmap(NULL, uc->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uc->ring_fd, IORING_OFF_SQ_RING);
+	uc->cq_ring = mmap(NULL, uc->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uc->ring_fd, IORING_OFF_CQ_RING);
+	uc->sqes = mmap(NULL, uc->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uc->ring_fd, IORING_OFF_SQES);
+	if (uc->sq_ring == MAP_FAILED || uc->cq_ring == MAP_FAILED || uc->sqes == MAP_FAILED) {
+		uring_copy_close(uc);
+		return NULL;
+	}
+
+	char* sq = uc->sq_ring;
+	char* cq = uc->cq_ring;
+	uc->sq_head = (unsigned*)(sq + params.sq_off.head);
+	uc->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+	uc->sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+	unsigned* sq_array = (unsigned*)(sq + params.sq_off.array);
+	for (unsigned i = 0; i < params.sq_entries; i++) {
+		sq_array[i] = i;
+	}
+	uc->cq_head = (unsigned*)(cq + params.cq_off.head);
+	uc->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+	uc->cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+	uc->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+	// every operation of the chains has to be there (openat, statx and close need 5.6)
+	size_t probe_size = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe* probe = calloc(1, probe_size);
+	int ops[] = {IORING_OP_STATX, IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE};
+	if (probe == NULL || syscall(__NR_io_uring_register, uc->ring_fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0) {
+		free(probe);
+		uring_copy_close(uc);
+		return NULL;
+	}
+	for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+		if (ops[i] > probe->last_op || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+			free(probe);
+			uring_copy_close(uc);
+			errno = ENOSYS;
+			return NULL;
+		}
+	}
+	free(probe);
+
+	// an empty table of direct descriptors, the openat calls fill it so that the
+	// read/write linked after them can use the file without knowing its fd
+	int slots[URING_SLOTS];
+	for (int i = 0; i < URING_SLOTS; i++) {
+		slots[i] = -1;
+	}
+	if (syscall(__NR_io_uring_register, uc->ring_fd, IORING_REGISTER_FILES, slots, URING_SLOTS) < 0
+		|| posix_memalign((void**)&uc->bufs, sysconf(_SC_PAGESIZE), (size_t)URING_BATCH * URING_FILE_MAX) != 0) {
+		uring_copy_close(uc);
+		return NULL;
+	}
+	if (!direct_open_works(uc)) {
+		uring_copy_close(uc);
+		errno = ENOSYS;
+		return NULL;
+	}
+	return uc;
+}
+
+
+void uring_copy_close(struct uring_copy* uc) {
+	if (uc->sqes != NULL && uc->sqes != MAP_FAILED) {
+		munmap(uc->sqes, uc->sqes_size);
+	}
+	if (uc->cq_ring != NULL && uc->cq_ring != MAP_FAILED) {
+		munmap(uc->cq_ring, uc->cq_ring_size);
+	}
+	if (uc->sq_ring != NULL && uc->sq_ring != MAP_FAILED) {
+		munmap(uc->sq_ring, uc->sq_ring_size);
+	}
+	close(uc->ring_fd);
+	free(uc->bufs);
+	free(uc);
+}
+
+
+int uring_copy_batch(struct uring_copy* uc, struct uring_file* files, int count) {
+	if (count > URING_BATCH) {
+		count = URING_BATCH;
+	}
+	uc->enters = 0;
+	for (int i = 0; i < count; i++) {
+		files[i].result = NOT_SUPPORTED;
+		memset(&files[i].stats, 0, sizeof(files[i].stats));
+		uc->failed[i] = 0;
+		memset(&uc->sx[i], 0, sizeof(uc->sx[i]));
+	}
+
+	// 1. statx for every file: type, mode and size decide what fits in a single chain
+	for (int i = 0; i < count; i++) {
+		struct io_uring_sqe* sqe = next_sqe(uc);
+		sqe->opcode = IORING_OP_STATX;
+		sqe->fd = files[i].src_dirfd;
+		sqe->addr = (unsigned long)files[i].src;
+		sqe->len = STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_NLINK;
+		sqe->statx_flags = files[i].follow ? 0 : AT_SYMLINK_NOFOLLOW;
+		sqe->off = (unsigned long)&uc->sx[i];
+		sqe->user_data = ((unsigned long)i << 3) | STEP_STATX;
+	}
+	if (submit_and_wait(uc) < 0) {
+		files[0].stats.calls = files[0].stats.calls_by_kind[CALL_URING] = uc->enters;
+		return uc->broken ? -1 : 0;
+	}
+
+	// 2. one linked chain per small regular file, a failing step cancels the rest of its chain
+	// (hard linked files too, the tree copy has to see them to link them)
+	int chained = 0;
+	for (int i = 0; i < count; i++) {
+		if (uc->failed[i] || !fits_chain(&uc->sx[i])) {
+			uc->failed[i] = 1;
+			continue;
+		}
+		unsigned size = uc->sx[i].stx_size;
+		char* buf = uc->bufs + (size_t)i * URING_FILE_MAX;
+		unsigned long id = (unsigned long)i << 3;
+
+		struct io_uring_sqe* sqe = next_sqe(uc);
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = files[i].src_dirfd;
+		sqe->addr = (unsigned long)files[i].src;
+		// no O_CLOEXEC, a direct descriptor isn't in the fd table and the kernel refuses it
+		sqe->open_flags = O_RDONLY | (files[i].follow ? 0 : O_NOFOLLOW);
+		sqe->file_index = 2 * i + 1;	// slot 2i, 0 would mean a normal fd
+		sqe->flags = IOSQE_IO_LINK;
+		sqe->user_data = id | STEP_OPEN_SRC;
+
+		sqe = next_sqe(uc);
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = 2 * i;
+		sqe->addr = (unsigned long)buf;
+		sqe->len = size;
+		sqe->off = 0;
+		sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+		sqe->user_data = id | STEP_READ;
+
+		sqe = next_sqe(uc);
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = files[i].dest_dirfd;
+		sqe->addr = (unsigned long)files[i].dest;
+		sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC;
+		sqe->len = uc->sx[i].stx_mode & 07777;
+		sqe->file_index = 2 * i + 2;	// slot 2i + 1
+		sqe->flags = IOSQE_IO_LINK;
+		sqe->user_data = id | STEP_OPEN_DEST;
+
+		sqe = next_sqe(uc);
+		sqe->opcode = IORING_OP_WRITE;
+		sqe->fd = 2 * i + 1;
+		sqe->addr = (unsigned long)buf;
+		sqe->len = size;
+		sqe->off = 0;
+		sqe->flags = IOSQE_FIXED_FILE;
+		sqe->user_data = id | STEP_WRITE;
+		chained++;
+	}
+	if (chained == 0 || submit_and_wait(uc) < 0) {
+		files[0].stats.calls = files[0].stats.calls_by_kind[CALL_URING] = uc->enters;
+		return uc->broken ? -1 : 0;
+	}
+
+	// 3. close both direct descriptors of every chain, outside the chains so that a
+	// cancelled chain doesn't leave its files open (closing an empty slot just fails)
+	for (int i = 0; i < count; i++) {
+		if (!fits_chain(&uc->sx[i])) {
+			continue;
+		}
+		for (int slot = 2 * i; slot <= 2 * i + 1; slot++) {
+			struct io_uring_sqe* sqe = next_sqe(uc);
+			sqe->opcode = IORING_OP_CLOSE;
+			sqe->file_index = slot + 1;
+			sqe->user_data = ((unsigned long)i << 3) | STEP_CLOSE;
+		}
+	}
+	if (submit_and_wait(uc) < 0) {
+		files[0].stats.calls = files[0].stats.calls_by_kind[CALL_URING] = uc->enters;
+		return uc->broken ? -1 : 0;
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (!uc->failed[i]) {
+			files[i].result = 0;
+			files[i].stats.strategy = COPY_URING;
+			files[i].stats.bytes = uc->sx[i].stx_size;
+			files[i].stats.threads = 1;
+		}
+	}
+	files[0].stats.calls = files[0].stats.calls_by_kind[CALL_URING] = uc->enters;
+	return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef COPY_URING_H
+#define COPY_URING_H
+
+#include "copy_engine.h"	// to use struct copy_stats
+
+#define URING_BATCH    64		// files submitted together
+#define URING_FILE_MAX (64 * 1024)	// bigger files are left to copy_fd
+
+// one io_uring instance, owned by a single thread
+struct uring_copy;
+
+struct uring_file {
+	int src_dirfd;		// src and dest are relative to these (AT_FDCWD works too)
+	const char* src;
+	int follow;		// follow a symlink named by src (command line operands)
+	int dest_dirfd;
+	const char* dest;
+	int result;		// 0 when copied, NOT_SUPPORTED when it has to be copied the usual way
+	struct copy_stats stats;
+};
+
+// NULL (errno set) when io_uring is missing, disabled (kernel.io_uring_disabled)
+// or lacks one of the operations the batches use, the caller copies synchronously then
+struct uring_copy* uring_copy_open(void);
+void uring_copy_close(struct uring_copy* uc);
+
+// copy up to URING_BATCH small regular files with three submissions for the whole batch:
+// all the statx calls, then a linked openat -> read -> openat -> write chain per file,
+// then all the close calls
+// every file gets its result, the files that didn't fit (too big, not regular, hard linked, an error
+// anywhere in their chain) get NOT_SUPPORTED and are better redone with copy_fd
+// the io_uring_enter calls of the whole batch are counted in files[0].stats
+// returns -1 when io_uring_enter failed: what the kernel had taken is finished (or the ring
+// can't wait anymore), every file is NOT_SUPPORTED and the ring should be closed
+int uring_copy_batch(struct uring_copy* uc, struct uring_file* files, int count);
+
+#endif
@@ -0,0 +1,108 @@
+#define _GNU_SOURCE		// to use O_DIRECT
+#include <unistd.h>		// to use pread, close, fdatasync, sysconf
+#include <fcntl.h>		// to use open, posix_fadvise, O_DIRECT
+#include <stdlib.h>		// to use posix_memalign, free
+#include <stdio.h>		// to use perror, fprintf, snprintf
+#include <errno.h>		// to use errno
+
+#include "copy_engine.h"
+#include "copy_checksum.h"	// to use crc32c
+
+#define VERIFY_BUF   (4 * 1024 * 1024)
+#define VERIFY_ALIGN 4096	// O_DIRECT reads need the buffer, the offset and the size aligned
+
+
+// crc32c of len bytes of fd from offset, 0 or READ_ERROR (with errno), a file shorter
+// than len gives a different checksum so the comparison fails by itself
+static int hash_file(int fd, off_t offset, unsigned long long len, int direct, char* buf, unsigned int* checksum) {
+	unsigned int crc = 0;
+	while (len > 0) {
+		// O_DIRECT reads whole blocks, the part past len is simply not hashed
+		size_t count = (direct || len > VERIFY_BUF) ? VERIFY_BUF : (size_t)len;
+		ssize_t num_bytes_read = pread(fd, buf, count, offset);
+		if (num_bytes_read < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return READ_ERROR;
+		}
+		if (num_bytes_read == 0) {
+			break;
+		}
+		size_t used = (unsigned long long)num_bytes_read < len ? (size_t)num_bytes_read : (size_t)len;
+		crc = crc32c(crc, buf, used);
+		offset += used;
+		len -= used;
+	}
+	*checksum = crc;
+	return 0;
+}
+
+// a second descriptor on the destination that can read, the copy one is usually O_WRONLY
+static int reopen_for_reading(int fd, int direct) {
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+	if (direct) {
+		int fd_read = open(path, O_RDONLY | O_CLOEXEC | O_DIRECT);
+		if (fd_read >= 0 || errno != EINVAL) {
+			return fd_read;
+		}
+		// the file system has no direct I/O, its pages were dropped anyway
+	}
+	return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+
+int copy_verify(int fd_src, int fd_dest, off_t src_base, off_t dest_base, enum verify_mode mode, struct copy_stats* stats) {
+	if (dest_base < 0 || (!stats->checksummed && src_base < 0)) {
+		fprintf(stderr, "Error in verifying the copy: a pipe can't be read a second time\n");
+		return VERIFY_ERROR;
+	}
+	int direct = mode == VERIFY_DIRECT && dest_base % VERIFY_ALIGN == 0;
+
+	char* buf;
+	if (posix_memalign((void**)&buf, VERIFY_ALIGN, VERIFY_BUF) != 0) {
+		perror("Unable to allocate the verification buffer");
+		return MALLOC_ERROR;
+	}
+
+	// a kernel-side copy never showed us the data, hash the source now
+	if (!stats->checksummed && hash_file(fd_src, src_base, stats->bytes, 0, buf, &stats->checksum) < 0) {
+		perror("Error in reading source file again");
+		free(buf);
+		return VERIFY_ERROR;
+	}
+
+	// the written pages have to reach the disk and leave the cache, otherwise
+	// the read back only proves that the page cache holds what we wrote
+	if (fdatasync(fd_dest) < 0 && errno != EINVAL) {
+		perror("Error in flushing destination file");
+		free(buf);
+		return VERIFY_ERROR;
+	}
+	posix_fadvise(fd_dest, dest_base, stats->bytes, POSIX_FADV_DONTNEED);
+
+	int fd_read = reopen_for_reading(fd_dest, direct);
+	if (fd_read < 0) {
+		perror("Error in opening destination file for verification");
+		free(buf);
+		return VERIFY_ERROR;
+	}
+	unsigned int dest_checksum;
+	int ret = hash_file(fd_read, dest_base, stats->bytes, direct, buf, &dest_checksum);
+	if (ret < 0) {
+		perror("Error in reading destination file back");
+		ret = VERIFY_ERROR;
+	}
+	else if (dest_checksum != stats->checksum) {
+		fprintf(stderr, "Error in verifying the copy: destination crc32c %08x, source crc32c %08x\n",
+			dest_checksum, stats->checksum);
+		ret = VERIFY_ERROR;
+	}
+	else {
+		stats->verified = 1;
+	}
+	close(fd_read);
+	free(buf);
+	return ret;
+}
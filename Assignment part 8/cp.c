@@ -1,91 +1,310 @@
-#include <unistd.h>	// to use write, read, close
-#include <string.h>	// to use strlen
-#include <stdio.h>	// to use perror
-#include <stdlib.h>	// to use exit
+#include <unistd.h>	// to use close
+#include <string.h>	// to use strlen, strcmp, strncmp, strrchr, memcpy
+#include <stdio.h>	// to use perror, fprintf
+#include <stdlib.h>	// to use exit, atoi, strtoll
 #include <fcntl.h>	// to use open
+#include <sys/stat.h>	// to use stat
+#include <limits.h>	// to use LLONG_MAX
 
-#define ARGUMENT_ERROR -1
-#define WRITE_ERROR    -2
-#define OPEN_ERROR     -3
-#define READ_ERROR     -4
-#define CLOSE_ERROR    -5
+#include "fileops.h"		// to use fileops_copy, fileops_check_operands, fileops_write_error, fileops_knows_options
+#include "copy_engine.h"	// to use struct copy_options and the error codes
+#include "copy_tree.h"		// to use tree_copy_start, tree_copy_add, tree_copy_finish
+#include "copy_bench.h"		// to use copy_bench
+#include "copy_metrics.h"	// to use metrics_parse_option, metrics_start, metrics_report
+#include "copy_sync.h"		// to use sync_parse_option, sync_fs
 
-#define COUNT 100
 
+// "64M" -> 67108864, accepts the K, M and G suffixes, returns -1 when it isn't a size
+static off_t parse_size(char* str) {
+	char* end;
+	long long size = strtoll(str, &end, 10);
+	if (end == str || size <= 0) {
+		return -1;
+	}
+	int shift = 0;
+	switch (*end) {
+		case 'K': case 'k':	shift = 10; end++; break;
+		case 'M': case 'm':	shift = 20; end++; break;
+		case 'G': case 'g':	shift = 30; end++; break;
+	}
+	if (*end != '\0' || size > (LLONG_MAX >> shift)) {
+		return -1; // shifting it would overflow
+	}
+	return size << shift;
+}
 
-int cp_main(int argc, char *argv[]) {
 
+// move the options out of argv and leave only the operands after argv[0],
+// so argc/argv look exactly as if no option was given
+// --bench=WHAT and --bench-files=N only fill bench and bench_files, --stats* fill metrics
+static int parse_options(int* argc, char* argv[], struct copy_options* opts, char** bench, int* bench_files, struct copy_metrics* metrics) {
+	int num_operands = 1;
+	int end_of_options = 0;
+	for (int i = 1; i < *argc; i++) {
+		char* arg = argv[i];
+		int is_stats = 0;
+		int is_sync = 0;
+		if (end_of_options || arg[0] != '-' || arg[1] == '\0') {
+			argv[num_operands++] = arg;
+		}
+		else if ((is_stats = metrics_parse_option(argv[0], arg, metrics)) != 0) {
+			if (is_stats < 0) {
+				return is_stats;
+			}
+		}
+		else if ((is_sync = sync_parse_option(argv[0], arg, opts)) != 0) {
+			if (is_sync < 0) {
+				return is_sync;
+			}
+		}
+		else if (strcmp(arg, "--") == 0) {
+			end_of_options = 1;
+		}
+		else if ((strcmp(arg, "-v") == 0) || (strcmp(arg, "--verbose") == 0)) {
+			opts->verbose = 1;
+		}
+		else if ((strcmp(arg, "-r") == 0) || (strcmp(arg, "-R") == 0) || (strcmp(arg, "--recursive") == 0)) {
+			opts->recursive = 1;
+		}
+		else if (strncmp(arg, "--threads=", 10) == 0) {
+			opts->threads = atoi(arg + 10);
+			if (opts->threads <= 0) {
+				return fileops_write_error(argv[0], ": invalid number of threads '", arg + 10, "'\n");
+			}
+		}
+		else if (strcmp(arg, "--parallel") == 0) {
+			opts->parallel = 1;
+		}
+		else if (strncmp(arg, "--chunk-size=", 13) == 0) {
+			opts->chunk_size = parse_size(arg + 13);
+			if (opts->chunk_size <= 0) {
+				return fileops_write_error(argv[0], ": invalid chunk size '", arg + 13, "'\n");
+			}
+		}
+		else if (strcmp(arg, "--pipeline") == 0) {
+			opts->pipeline = 1;
+		}
+		else if (strcmp(arg, "--direct") == 0) {
+			opts->direct = 1;
+		}
+		else if (strcmp(arg, "--stream") == 0) {
+			opts->stream = 1;
+		}
+		else if (strncmp(arg, "--sparse=", 9) == 0) {
+			char* when = arg + 9;
+			if (strcmp(when, "auto") == 0) {
+				opts->sparse = SPARSE_AUTO;
+			}
+			else if (strcmp(when, "never") == 0) {
+				opts->sparse = SPARSE_NEVER;
+			}
+			else if (strcmp(when, "always") == 0) {
+				opts->sparse = SPARSE_ALWAYS;
+			}
+			else {
+				return fileops_write_error(argv[0], ": invalid argument '", when, "' for '--sparse'\n");
+			}
+		}
+		else if (strncmp(arg, "--reflink=", 10) == 0) {
+			char* when = arg + 10;
+			if (strcmp(when, "auto") == 0) {
+				opts->reflink = REFLINK_AUTO;
+			}
+			else if (strcmp(when, "never") == 0) {
+				opts->reflink = REFLINK_NEVER;
+			}
+			else if (strcmp(when, "always") == 0) {
+				opts->reflink = REFLINK_ALWAYS;
+			}
+			else {
+				return fileops_write_error(argv[0], ": invalid argument '", when, "' for '--reflink'\n");
+			}
+		}
+		else if (strcmp(arg, "--reflink") == 0) {
+			opts->reflink = REFLINK_ALWAYS;
+		}
+		else if (strcmp(arg, "--preserve=links") == 0) {
+			opts->break_links = 0;
+		}
+		else if (strcmp(arg, "--no-preserve=links") == 0) {
+			opts->break_links = 1;
+		}
+		else if (strcmp(arg, "--delta") == 0) {
+			opts->delta = 1;
+		}
+		else if (strcmp(arg, "--verify") == 0) {
+			opts->verify = VERIFY_BUFFERED;
+		}
+		else if (strncmp(arg, "--verify=", 9) == 0) {
+			char* how = arg + 9;
+			if (strcmp(how, "buffered") == 0) {
+				opts->verify = VERIFY_BUFFERED;
+			}
+			else if (strcmp(how, "direct") == 0) {
+				opts->verify = VERIFY_DIRECT;
+			}
+			else {
+				return fileops_write_error(argv[0], ": invalid argument '", how, "' for '--verify'\n");
+			}
+		}
+		else if (strncmp(arg, "--engine=", 9) == 0) {
+			char* name = arg + 9;
+			if (strcmp(name, "sync") == 0) {
+				opts->engine = ENGINE_SYNC;
+			}
+			else if (strcmp(name, "uring") == 0) {
+				opts->engine = ENGINE_URING;
+			}
+			else {
+				return fileops_write_error(argv[0], ": invalid argument '", name, "' for '--engine'\n");
+			}
+		}
+		else if (strncmp(arg, "--bench=", 8) == 0) {
+			*bench = arg + 8;
+		}
+		else if (strncmp(arg, "--bench-files=", 14) == 0) {
+			*bench_files = atoi(arg + 14);
+			if (*bench_files <= 0) {
+				return fileops_write_error(argv[0], ": invalid number of files '", arg + 14, "'\n");
+			}
+		}
+		else {
+			return fileops_write_error(argv[0], ": unrecognized option '", arg, "'\n");
+		}
+	}
+	argv[num_operands] = NULL;
+	*argc = num_operands;
+	return 0;
+}
 
 
-	if (argc == 1) {
-		// missing source file operand
-		char* error_msg = ": missing file operand\n";
-		// write to std error file --> "%s: missing file operand\n", argv[0]
-		if ((write(2, argv[0], strlen(argv[0])) < 0) || (write(2, error_msg, strlen(error_msg)) < 0)) {
-			perror("Error in writing to standard error file");
-			exit(WRITE_ERROR);
-		}
-		exit(ARGUMENT_ERROR);
+// last component of a path, trailing slashes are cut off in place
+static char* base_name(char* path) {
+	size_t len = strlen(path);
+	while (len > 1 && path[len - 1] == '/') {
+		path[--len] = '\0';
 	}
-	else if (argc == 2) {
-		// missing destination file operand
-		char* error_msg = ": missing destination file operand after '";
-		// write to std error file --> "%s: missing destination file operand after '%s'\n", argv[0], argv[1]
-		if ((write(2, argv[0], strlen(argv[0])) < 0) || (write(2, error_msg, strlen(error_msg)) < 0)
-			|| (write(2, argv[1], strlen(argv[1])) < 0) || (write(2, "'\n", 2) < 0)) {
-			perror("Error in writing to standard error file");
-			exit(WRITE_ERROR);
+	char* slash = strrchr(path, '/');
+	return (slash != NULL && slash[1] != '\0') ? slash + 1 : path;
+}
+
+// cp SOURCE... DIRECTORY and cp -r DIR DEST go through the tree copy pool:
+// into DIRECTORY every source keeps its name, otherwise the single DIR is copied as DEST
+static int copy_many(int argc, char* argv[], int dest_is_dir, const struct copy_options* opts, const struct copy_metrics* metrics) {
+	char* dest = argv[argc - 1];
+	int dest_fd = AT_FDCWD;
+	if (dest_is_dir) {
+		dest_fd = open(dest, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (dest_fd < 0) {
+			perror("Error in opening destination directory");
+			return OPEN_ERROR;
 		}
-		exit(ARGUMENT_ERROR);
 	}
-	// copying multiple files into a directory isn't supported
 
-	int fd_src = open(argv[1], O_RDONLY);
-	if (fd_src < 0) {
-		char* error_msg_1 = ": cannot stat '";
-		char* error_msg_2 = "': No such file or directory\n";
-		// write to std error file --> "%s: cannot stat '%s': No such file or directory\n", argv[0], argv[1]
-		if ((write(2, argv[0], strlen(argv[0])) < 0) || (write(2, error_msg_1, strlen(error_msg_1)) < 0)
-			|| (write(2, argv[1], strlen(argv[1])) < 0) || (write(2, error_msg_2, strlen(error_msg_2)) < 0)) {
-			perror("Error in writing to standard error file");
-			exit(WRITE_ERROR);
+	struct tree_copy* tc = tree_copy_start(argv[0], opts);
+	if (tc == NULL) {
+		if (dest_fd >= 0) {
+			close(dest_fd);
+		}
+		return THREAD_ERROR;
+	}
+	for (int i = 1; i < argc - 1; i++) {
+		if (dest_is_dir) {
+			tree_copy_add(tc, argv[i], dest_fd, dest, base_name(argv[i]));
 		}
-		// to print errno
-		// perror("Error in opening source file");
-		exit(OPEN_ERROR);
+		else {
+			tree_copy_add(tc, argv[i], AT_FDCWD, "", dest);
+		}
+	}
+	struct tree_totals totals;
+	int ret = tree_copy_finish(tc, &totals);
+	if (ret == 0 && opts->sync == SYNC_FS) {
+		ret = sync_fs(dest, &totals.stats);
+	}
+
+	if (dest_fd >= 0 && close(dest_fd) < 0) {
+		perror("Error in closing destination directory");
+		return CLOSE_ERROR;
+	}
+	if (opts->verbose) {
+		fprintf(stderr, "%s: %llu files, %llu hard links, %llu directories, %llu other entries, %llu bytes\n",
+			argv[0], totals.files, totals.links, totals.dirs, totals.others, totals.stats.bytes);
 	}
+	if (opts->delta) {
+		// the point of --delta, reported even without -v
+		fprintf(stderr, "%s: %llu bytes unchanged, %llu bytes rewritten\n",
+			argv[0], totals.stats.skipped_bytes, totals.stats.bytes - totals.stats.skipped_bytes - totals.stats.hole_bytes);
+	}
+	if (ret == 0) {
+		ret = metrics_report(metrics, argv[0], totals.files, &totals.stats);
+	}
+	return ret;
+}
+
+
+// every option parse_options knows (with the --stats and --sync ones)
+static const char* const cp_options[] = {
+	"-v", "--verbose", "-r", "-R", "--recursive", "--threads=", "--parallel", "--chunk-size=",
+	"--pipeline", "--direct", "--stream", "--sparse=", "--reflink=", "--reflink",
+	"--preserve=links", "--no-preserve=links", "--delta", "--verify", "--verify=", "--engine=",
+	"--bench=", "--bench-files=", "--stats", "--stats=", "--stats-file=", "--sync=", NULL
+};
 
-	int fd_dest = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644);
-	if (fd_dest < 0) {
-		perror("Error in opening or creating destination file");
-		exit(OPEN_ERROR);
+int fileops_cp_handles(int argc, char* argv[]) {
+	return fileops_knows_options(argc, argv, cp_options);
+}
+
+int fileops_cp(int argc, char* argv[]) {
+	// the options are moved out of a copy, the caller's argv stays as it was
+	char* args[argc + 1];
+	memcpy(args, argv, argc * sizeof(char*));
+	args[argc] = NULL;
+	argv = args;
+
+	struct copy_options opts = {0};
+	char* bench = NULL;
+	int bench_files = BENCH_FILES;
+	struct copy_metrics metrics = {0};
+	int ret = parse_options(&argc, argv, &opts, &bench, &bench_files, &metrics);
+	if (ret < 0) {
+		return ret;
 	}
+	metrics_start(&metrics);
 
-	char buf[COUNT];
-	int num_bytes_read;
-	do {
-		num_bytes_read = read(fd_src, buf, COUNT);
-		if (num_bytes_read < 0) {
-			perror("Error in reading from source file");
-			exit(READ_ERROR);
-		}
-		if (num_bytes_read > 0) {
-			if (write(fd_dest, buf, num_bytes_read) < 0) {
-				perror("Error in writing to destination file");
-				exit(WRITE_ERROR);
-			}
-		}
+	if (bench != NULL) {
+		// no operands, the benchmark makes up its own files
+		return copy_bench(argv[0], bench, bench_files, &opts);
+	}
+
+	ret = fileops_check_operands(argc, argv);
+	if (ret < 0) {
+		return ret;
 	}
-	while (num_bytes_read > 0);
 
+	// several sources, a directory as destination or a directory to copy
+	struct stat st;
+	int dest_is_dir = (stat(argv[argc - 1], &st) == 0) && S_ISDIR(st.st_mode);
+	if (argc > 3 && !dest_is_dir) {
+		return fileops_write_error(argv[0], ": target '", argv[argc - 1], "' is not a directory\n");
+	}
+	if (dest_is_dir || ((stat(argv[1], &st) == 0) && S_ISDIR(st.st_mode))) {
+		return copy_many(argc, argv, dest_is_dir, &opts, &metrics);
+	}
 
-	if (close(fd_src) < 0) {
-		perror("Error in closing source file descriptor");
-		exit(CLOSE_ERROR);
+	struct copy_stats stats;
+	ret = fileops_copy(argv[0], argv[1], argv[2], &opts, &stats);
+	if (ret < 0) {
+		return ret;
 	}
-	if (close(fd_dest) < 0) {
-		perror("Error in closing destination file descriptor");
-		exit(CLOSE_ERROR);
+	return metrics_report(&metrics, argv[0], 1, &stats);
+}
+
+
+int cp_main(int argc, char *argv[]) {
+
+	int ret = fileops_cp(argc, argv);
+	if (ret < 0) {
+		exit(ret);
 	}
 	return 0;
 
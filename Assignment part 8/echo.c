@@ -1,21 +1,24 @@
-
-#include <unistd.h>   // for write
-#include <string.h>   // for strlen
 #include <stdio.h>    // for perror
 
+#include "outbuf.h"   // for out_init, out_str, out_write, out_flush
+
 #define WRITE_ERROR -1
 
 int echo_main(int argc, char *argv[]) {
+    // The whole line is gathered and written with one syscall at the end
+    struct out_buf out;
+    out_init(&out, 1);
+
     for (int i = 1; i < argc; ++i) {
         // Write the argument
-        if (write(STDOUT_FILENO, argv[i], strlen(argv[i])) < 0) {
+        if (out_str(&out, argv[i]) < 0) {
             perror("echo: write failed");
             return WRITE_ERROR;
         }
 
         // Write a space after each word except the last one
         if (i < argc - 1) {
-            if (write(STDOUT_FILENO, " ", 1) < 0) {
+            if (out_write(&out, " ", 1) < 0) {
                 perror("echo: write failed");
                 return WRITE_ERROR;
             }
@@ -23,7 +26,7 @@ int echo_main(int argc, char *argv[]) {
     }
 
     // Write a newline at the end
-    if (write(STDOUT_FILENO, "\n", 1) < 0) {
+    if (out_write(&out, "\n", 1) < 0 || out_flush(&out) < 0) {
         perror("echo: write failed");
         return WRITE_ERROR;
     }
@@ -0,0 +1,111 @@
+#include <unistd.h>	// to use write, close
+#include <string.h>	// to use strlen, strcmp, strncmp
+#include <stdio.h>	// to use perror
+#include <fcntl.h>	// to use open
+
+#include "fileops.h"
+#include "copy_engine.h"	// to use copy_fd and the error codes
+#include "copy_sync.h"		// to use sync_close, sync_flush, sync_fs
+
+
+int fileops_write_error(const char* prog, const char* msg_1, const char* arg, const char* msg_2) {
+	if ((write(2, prog, strlen(prog)) < 0) || (write(2, msg_1, strlen(msg_1)) < 0)
+		|| (write(2, arg, strlen(arg)) < 0) || (write(2, msg_2, strlen(msg_2)) < 0)) {
+		perror("Error in writing to standard error file");
+		return WRITE_ERROR;
+	}
+	return ARGUMENT_ERROR;
+}
+
+int fileops_knows_options(int argc, char* argv[], const char* const known[]) {
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		if (arg[0] != '-' || arg[1] == '\0') {
+			continue; // an operand
+		}
+		if (strcmp(arg, "--") == 0) {
+			return 1;
+		}
+		int found = 0;
+		for (int k = 0; known[k] != NULL && !found; k++) {
+			size_t len = strlen(known[k]);
+			found = known[k][len - 1] == '=' ? strncmp(arg, known[k], len) == 0 : strcmp(arg, known[k]) == 0;
+		}
+		if (!found) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int fileops_check_operands(int argc, char* argv[]) {
+	if (argc == 1) {
+		// missing source file operand
+		char* error_msg = ": missing file operand\n";
+		// write to std error file --> "%s: missing file operand\n", argv[0]
+		if ((write(2, argv[0], strlen(argv[0])) < 0) || (write(2, error_msg, strlen(error_msg)) < 0)) {
+			perror("Error in writing to standard error file");
+			return WRITE_ERROR;
+		}
+		return ARGUMENT_ERROR;
+	}
+	else if (argc == 2) {
+		// missing destination file operand
+		return fileops_write_error(argv[0], ": missing destination file operand after '", argv[1], "'\n");
+	}
+	return 0;
+}
+
+
+int fileops_copy(const char* prog, const char* src, const char* dest, const struct copy_options* opts, struct copy_stats* stats) {
+	struct copy_options default_opts = {0};
+	struct copy_stats local_stats;
+	if (opts == NULL) {
+		opts = &default_opts;
+	}
+	if (stats == NULL) {
+		stats = &local_stats;
+	}
+
+	int fd_src = open(src, O_RDONLY | O_CLOEXEC);
+	if (fd_src < 0) {
+		// to print errno: perror("Error in opening source file");
+		return fileops_write_error(prog, ": cannot stat '", src, "': No such file or directory\n") == WRITE_ERROR ? WRITE_ERROR : OPEN_ERROR;
+	}
+
+	// --delta keeps the destination and reads it to find what changed
+	int fd_dest = open(dest, (opts->delta ? O_RDWR : O_WRONLY | O_TRUNC) | O_CREAT | O_CLOEXEC, 0644);
+	if (fd_dest < 0) {
+		perror("Error in opening or creating destination file");
+		close(fd_src);
+		return OPEN_ERROR;
+	}
+
+	// copy_file_range -> sendfile -> splice -> read/write, whichever works first
+	int ret = copy_fd(fd_src, fd_dest, opts, stats);
+	if (ret < 0) {
+		close(fd_src);
+		close(fd_dest);
+		return ret;
+	}
+	if (opts->verbose || opts->delta) {
+		copy_report(stderr, prog, src, dest, stats);
+	}
+
+	if (close(fd_src) < 0) {
+		perror("Error in closing source file descriptor");
+		close(fd_dest);
+		return CLOSE_ERROR;
+	}
+	// --sync: fdatasync it, or start its writeback and wait for it, or flush the file system
+	struct sync_batch sb;
+	sb.count = 0;
+	ret = sync_close(fd_dest, opts, &sb, stats);
+	if (ret == 0) {
+		ret = sync_flush(&sb, stats);
+	}
+	if (ret == 0 && opts->sync == SYNC_FS) {
+		ret = sync_fs(dest, stats);
+	}
+	return ret;
+}
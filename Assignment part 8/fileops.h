@@ -0,0 +1,46 @@
+#ifndef FILEOPS_H
+#define FILEOPS_H
+
+// the cp and mv commands as a library: they return their status instead of calling
+// exit, so a caller that stays alive (the shells' builtins) runs them without fork
+// this header only declares the structs of copy_engine.h, its error codes would clash
+// with the ones of the shells
+
+struct copy_options;
+struct copy_stats;
+
+// run "cp ARGS..." / "mv ARGS..." in this process, argv[0] is the name used in the messages,
+// argv itself isn't modified (the operands are, trailing slashes are cut off)
+// returns 0 or one of the negative error codes of copy_engine.h
+int fileops_cp(int argc, char* argv[]);
+int fileops_mv(int argc, char* argv[]);
+
+// 1 when fileops_cp / fileops_mv knows every option of argv, so a shell can run the command
+// as a builtin, 0 when it is one for the system's cp / mv (cp -p, mv -f...)
+int fileops_cp_handles(int argc, char* argv[]);
+int fileops_mv_handles(int argc, char* argv[]);
+
+// copy the file src to dest (created or truncated, or updated with opts->delta) with the
+// copy engine, opts may be NULL for the defaults, stats may be NULL
+int fileops_copy(const char* prog, const char* src, const char* dest, const struct copy_options* opts, struct copy_stats* stats);
+
+// move src to dest like "mv src dest": a rename, or a copy when they are on different
+// file systems, opts (may be NULL) only gives the --sync policy, fs by default
+int fileops_move(const char* prog, const char* src, const char* dest, const struct copy_options* opts, struct copy_stats* stats);
+
+
+// shared by cp.c and mv.c
+
+// "missing file operand" / "missing destination file operand after" when argc is 1 or 2,
+// returns 0 when there are enough operands, ARGUMENT_ERROR or WRITE_ERROR otherwise
+int fileops_check_operands(int argc, char* argv[]);
+
+// write to std error file --> "%s%s%s%s", prog, msg_1, arg, msg_2, returns ARGUMENT_ERROR
+// (or WRITE_ERROR when stderr can't be written)
+int fileops_write_error(const char* prog, const char* msg_1, const char* arg, const char* msg_2);
+
+// 1 when every option of argv (before "--") is in the NULL terminated known list,
+// a name there that ends with '=' matches any value
+int fileops_knows_options(int argc, char* argv[], const char* const known[]);
+
+#endif
@@ -1,102 +1,582 @@
-#include <unistd.h>	// to use write, read, close, unlink
-#include <string.h>	// to use strlen
-#include <stdio.h>	// to use perror, rename
+#define _GNU_SOURCE	// to use syncfs, renameat2, O_PATH, O_TMPFILE
+#include <unistd.h>	// to use close, unlink, linkat, fsync, fdatasync, syncfs, readlinkat, symlinkat
+#include <string.h>	// to use strlen, strcmp, strncmp, strrchr, strerror, memcpy
+#include <stdio.h>	// to use perror, renameat2, fprintf, snprintf
 #include <stdlib.h>	// to use exit
-#include <fcntl.h>	// to use open
+#include <fcntl.h>	// to use open, openat, AT_FDCWD, O_PATH, O_TMPFILE
+#include <sys/stat.h>	// to use fstat, fstatat
+#include <errno.h>	// to use errno
+#include <limits.h>	// to use PATH_MAX, NAME_MAX
 
-#define ARGUMENT_ERROR -1
-#define WRITE_ERROR    -2
-#define OPEN_ERROR     -3
-#define READ_ERROR     -4
-#define CLOSE_ERROR    -5
-#define UNLINK_ERROR   -6
+#include "fileops.h"		// to use fileops_check_operands, fileops_knows_options, fileops_write_error
+#include "copy_engine.h"	// to use copy_fd and the error codes
+#include "copy_metrics.h"	// to use metrics_parse_option, metrics_start, metrics_report
+#include "copy_tree.h"		// to use tree_copy_start, tree_copy_add, tree_copy_finish
+#include "copy_remove.h"	// to use tree_remove
+#include "copy_sync.h"		// to use sync_parse_option, sync_written, sync_wait
 
-#define COUNT 100
 
-int mv_main(int argc, char *argv[]) {
+// move the options out of argv and leave only the operands after argv[0], like cp does
+static int parse_options(int* argc, char* argv[], struct copy_options* opts, struct copy_metrics* metrics) {
+	int num_operands = 1;
+	int end_of_options = 0;
+	for (int i = 1; i < *argc; i++) {
+		char* arg = argv[i];
+		if (end_of_options || arg[0] != '-' || arg[1] == '\0') {
+			argv[num_operands++] = arg;
+		}
+		else if (strcmp(arg, "--") == 0) {
+			end_of_options = 1;
+		}
+		else if (strncmp(arg, "--engine=", 9) == 0) {
+			char* name = arg + 9;
+			if (strcmp(name, "sync") == 0) {
+				opts->engine = ENGINE_SYNC;
+			}
+			else if (strcmp(name, "uring") == 0) {
+				opts->engine = ENGINE_URING;
+			}
+			else {
+				return fileops_write_error(argv[0], ": invalid argument '", name, "' for '--engine'\n");
+			}
+		}
+		else {
+			int ret = metrics_parse_option(argv[0], arg, metrics);
+			if (ret == 0) {
+				ret = sync_parse_option(argv[0], arg, opts);
+			}
+			if (ret < 0) {
+				return ret;
+			}
+			if (ret == 0) {
+				fprintf(stderr, "%s: unrecognized option '%s'\n", argv[0], arg);
+				return ARGUMENT_ERROR;
+			}
+		}
+	}
+	argv[num_operands] = NULL;
+	*argc = num_operands;
+	return 0;
+}
+
 
+// directories of the sources, kept open so that the sources of a same directory
+// are renamed relative to it and only their last component is resolved
+#define DIR_CACHE 16
 
+struct dir_cache {
+	int fd[DIR_CACHE];
+	char path[DIR_CACHE][PATH_MAX];
+	int count;
+	int next;	// slot replaced when the cache is full
+};
 
-	if (argc == 1) {
-		// missing source file operand
-		char* error_msg = ": missing file operand\n";
-		// write to std error file --> "%s: missing file operand\n", argv[0]
-		if ((write(2, argv[0], strlen(argv[0])) < 0) || (write(2, error_msg, strlen(error_msg)) < 0)) {
-			perror("Error in writing to standard error file");
-			exit(WRITE_ERROR);
+// fd of the directory dir ("" for the working directory), -1 when it can't be opened
+static int cached_dirfd(struct dir_cache* cache, const char* dir) {
+	if (dir[0] == '\0') {
+		return AT_FDCWD;
+	}
+	for (int i = 0; i < cache->count; i++) {
+		if (strcmp(cache->path[i], dir) == 0) {
+			return cache->fd[i];
 		}
-		exit(ARGUMENT_ERROR);
 	}
-	else if (argc == 2) {
-		// missing destination file operand
-		char* error_msg = ": missing destination file operand after '";
-		// write to std error file --> "%s: missing destination file operand after '%s'\n", argv[0], argv[1]
-		if ((write(2, argv[0], strlen(argv[0])) < 0) || (write(2, error_msg, strlen(error_msg)) < 0)
-			|| (write(2, argv[1], strlen(argv[1])) < 0) || (write(2, "'\n", 2) < 0)) {
-			perror("Error in writing to standard error file");
-			exit(WRITE_ERROR);
+	// O_PATH: the fd only anchors the *at calls, nothing is read through it
+	int fd = open(dir, O_PATH | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	int slot;
+	if (cache->count < DIR_CACHE) {
+		slot = cache->count++;
+	}
+	else {
+		slot = cache->next;
+		cache->next = (cache->next + 1) % DIR_CACHE;
+		close(cache->fd[slot]);
+	}
+	cache->fd[slot] = fd;
+	snprintf(cache->path[slot], PATH_MAX, "%s", dir);
+	return fd;
+}
+
+static void close_dirs(struct dir_cache* cache) {
+	for (int i = 0; i < cache->count; i++) {
+		close(cache->fd[i]);
+	}
+}
+
+// "a/b/c/" -> dir "a/b", returns "c" (trailing slashes are cut off in place), "c" -> dir ""
+static char* split_path(char* path, char* dir) {
+	size_t len = strlen(path);
+	while (len > 1 && path[len - 1] == '/') {
+		path[--len] = '\0';
+	}
+	char* slash = strrchr(path, '/');
+	if (slash == NULL || slash[1] == '\0') {
+		dir[0] = '\0';
+		return path;
+	}
+	size_t dir_len = slash == path ? 1 : (size_t)(slash - path);
+	snprintf(dir, PATH_MAX, "%.*s", (int)dir_len, path);
+	return slash + 1;
+}
+
+
+// mv of a directory to another file system: copy the tree with the worker pool, make the
+// copy durable (by default with a single syncfs of the destination file system instead of
+// a fsync per file), and only then remove the source tree from several threads
+static int move_tree(const char* prog, char* src, int dest_dirfd, char* dest_dir, char* dest_name, enum sync_policy sync,
+	enum copy_engine engine, struct copy_stats* stats, unsigned long long* files) {
+	struct copy_options opts = {0};
+	opts.recursive = 1;
+	opts.sync = sync;	// file and batch are done by the workers
+	opts.engine = engine;	// --engine=uring batches the small files like cp -r does
+	struct tree_copy* tc = tree_copy_start(prog, &opts);
+	if (tc == NULL) {
+		return THREAD_ERROR;
+	}
+	tree_copy_add(tc, src, dest_dirfd, dest_dir, dest_name);
+	struct tree_totals totals;
+	int ret = tree_copy_finish(tc, &totals);
+	copy_stats_add(stats, &totals.stats);
+	*files += totals.files;
+	if (ret < 0) {
+		fprintf(stderr, "%s: '%s' was not copied completely, the source is left in place\n", prog, src);
+		return ret;
+	}
+
+	// file and batch made the data of each file durable but not the directories the copy
+	// created nor their entries, the source can only go once all of it is on disk
+	if (sync != SYNC_NONE) {
+		int fd_dest = openat(dest_dirfd, dest_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (fd_dest < 0) {
+			perror("Error in opening destination directory");
+			return OPEN_ERROR;
+		}
+		if (syncfs(fd_dest) < 0) {
+			perror("Error in flushing the destination file system");
+			close(fd_dest);
+			return WRITE_ERROR;
 		}
-		exit(ARGUMENT_ERROR);
+		copy_count_call(stats, CALL_SYNC);
+		close(fd_dest);
 	}
-	// copying multiple files into a directory isn't supported
 
-	int fd_src = open(argv[1], O_RDONLY);
-	if (fd_src < 0) {
-		char* error_msg_1 = ": cannot state '";
-		char* error_msg_2 = "': No such file or directory\n";
-		// write to std error file --> "%s: cannot stat '%s': No such file or directory\n", argv[0], argv[1]
-		if ((write(2, argv[0], strlen(argv[0])) < 0) || (write(2, error_msg_1, strlen(error_msg_1)) < 0)
-			|| (write(2, argv[1], strlen(argv[1])) < 0) || (write(2, error_msg_2, strlen(error_msg_2)) < 0)) {
-			perror("Error in writing to standard error file");
-			exit(WRITE_ERROR);
+	return tree_remove(prog, src, 0, NULL);
+}
+
+// files copied to another file system but not yet in place: they are written to
+// unnamed O_TMPFILE files (or hidden temporary names), flushed together and only
+// then linked under their final names, so a crash never leaves a partial file
+// under a name someone may be watching, and the source is deleted last
+#define MOVE_BATCH 64
+
+struct pending_file {
+	int fd;
+	int dirfd;		// directory of the destination
+	int own_dirfd;		// dirfd was opened for this file and is closed with it
+	char name[NAME_MAX + 1];
+	char tmp_name[NAME_MAX + 1];	// "" for an O_TMPFILE file
+	char* src_path;
+};
+
+struct move_batch {
+	struct pending_file files[MOVE_BATCH];
+	int count;
+	enum sync_policy sync;	// --sync, fs unless told otherwise
+	enum copy_engine engine;	// --engine, for the trees copied to another file system
+};
+
+static void temp_name(char* tmp, const char* name) {
+	static unsigned int counter;
+	char buf[NAME_MAX + 1];	// name may live in the same pending_file as tmp
+	snprintf(buf, sizeof(buf), ".%.200s.mv%d.%u", name, (int)getpid(), counter++);
+	memcpy(tmp, buf, sizeof(buf));
+}
+
+// give the temporary file its final name, replacing a file that already has it
+static int link_in_place(struct pending_file* file) {
+	if (file->tmp_name[0] == '\0') {
+		char proc_path[64];
+		snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", file->fd);
+		if (linkat(AT_FDCWD, proc_path, file->dirfd, file->name, AT_SYMLINK_FOLLOW) == 0) {
+			return 0;
+		}
+		if (errno != EEXIST) {
+			return -1;
+		}
+		// linkat never replaces, name it first and rename it over the old file
+		temp_name(file->tmp_name, file->name);
+		if (linkat(AT_FDCWD, proc_path, file->dirfd, file->tmp_name, AT_SYMLINK_FOLLOW) < 0) {
+			file->tmp_name[0] = '\0';
+			return -1;
 		}
-		// to print errno
-		// perror("Error in opening source file");
-		exit(OPEN_ERROR);
 	}
+	return renameat(file->dirfd, file->tmp_name, file->dirfd, file->name);
+}
 
-	// check if rename can work first to reduce complexity
-	if (rename(argv[1], argv[2]) == 0) {
-    		return 0;
+static void drop_pending(struct pending_file* file) {
+	if (file->tmp_name[0] != '\0') {
+		unlinkat(file->dirfd, file->tmp_name, 0);
 	}
+	close(file->fd);
+	if (file->own_dirfd) {
+		close(file->dirfd);
+	}
+}
 
-	int fd_dest = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644);
-	if (fd_dest < 0) {
-		perror("Error in opening or creating destination file");
-		exit(OPEN_ERROR);
+// one flush for the whole batch, then the links, the directories and the sources
+static int flush_moves(const char* prog, struct move_batch* batch, struct copy_stats* stats) {
+	int error = 0;
+	if (batch->count == 0) {
+		return 0;
+	}
+	if (batch->sync == SYNC_FS) {
+		// the files of a batch all go to the same file system, a single syncfs flushes
+		// them together where fdatasync would wait for the disk once per file
+		int ret = batch->count == 1 ? fdatasync(batch->files[0].fd) : syncfs(batch->files[0].fd);
+		if (ret < 0) {
+			perror("Error in flushing the destination files");
+			error = WRITE_ERROR;
+		}
+		copy_count_call(stats, CALL_SYNC);
+	}
+	else if (batch->sync == SYNC_BATCH) {
+		// their writeback was started as each one was copied
+		int fds[MOVE_BATCH];
+		for (int i = 0; i < batch->count; i++) {
+			fds[i] = batch->files[i].fd;
+		}
+		error = sync_wait(fds, batch->count, stats);
 	}
 
-	char buf[COUNT];
-	int num_bytes_read;
-	do {
-		num_bytes_read = read(fd_src, buf, COUNT);
-		if (num_bytes_read < 0) {
-			perror("Error in reading from source file");
-			exit(READ_ERROR);
+	// files[0..done) are linked in place (and their directories are on disk with a sync
+	// policy), their sources go away even when a later file fails, or both would stay
+	int done = 0;
+	for (int i = 0; i < batch->count && error == 0; i++) {
+		struct pending_file* file = &batch->files[i];
+		int linked = link_in_place(file) == 0;
+		if (!linked) {
+			fprintf(stderr, "%s: cannot create '%s': %s\n", prog, file->name, strerror(errno));
+			error = WRITE_ERROR;
+		}
+		else {
+			file->tmp_name[0] = '\0';
+		}
+		int last = i + 1 == batch->count || batch->files[i + 1].dirfd != file->dirfd;
+		if (batch->sync == SYNC_NONE) {
+			done = i + linked;
+		}
+		else if (i + linked > done && (last || !linked)) {
+			// the new entries have to be on disk before the sources lose their own, the ones
+			// since done are all in this directory (a new directory fsyncs the previous one)
+			if (fsync(file->dirfd) < 0) {
+				perror("Error in flushing the destination directory");
+				error = WRITE_ERROR;
+				break;
+			}
+			copy_count_call(stats, CALL_SYNC);
+			done = i + linked;
 		}
-		if (num_bytes_read > 0) {
-			if (write(fd_dest, buf, num_bytes_read) < 0) {
-				perror("Error in writing to destination file");
-				exit(WRITE_ERROR);
+	}
+	for (int i = 0; i < done; i++) {
+		if (unlink(batch->files[i].src_path) < 0) {
+			perror("Error in deleting the source file");
+			if (error == 0) {
+				error = UNLINK_ERROR;
 			}
 		}
 	}
-	while (num_bytes_read > 0);
 
+	for (int i = 0; i < batch->count; i++) {
+		drop_pending(&batch->files[i]);
+	}
+	batch->count = 0;
+	return error;
+}
+
+// rename failed (different file systems), so copy the file and queue it in the batch,
+// the source is deleted when the batch is flushed
+static int move_file(const char* prog, int src_dirfd, char* src_name, char* src_path, int dest_dirfd, char* dest_name,
+	struct move_batch* batch, struct copy_stats* stats) {
+	int fd_src = openat(src_dirfd, src_name, O_RDONLY | O_CLOEXEC);
+	if (fd_src < 0) {
+		perror("Error in opening source file");
+		return OPEN_ERROR;
+	}
+	struct stat st;
+	if (fstat(fd_src, &st) < 0) {
+		perror("Error in reading the source file status");
+		close(fd_src);
+		return OPEN_ERROR;
+	}
+
+	struct pending_file* file = &batch->files[batch->count];
+	char dir[PATH_MAX];
+	char dest_path[PATH_MAX];
+	snprintf(dest_path, sizeof(dest_path), "%s", dest_name);
+	snprintf(file->name, sizeof(file->name), "%s", split_path(dest_path, dir));
+	file->src_path = src_path;
+	file->tmp_name[0] = '\0';
+	file->dirfd = dest_dirfd;
+	file->own_dirfd = dir[0] != '\0' || dest_dirfd == AT_FDCWD;
+	if (file->own_dirfd) {
+		// the directory is needed as an fd to create the file in it and to fsync it
+		file->dirfd = openat(dest_dirfd, dir[0] != '\0' ? dir : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (file->dirfd < 0) {
+			perror("Error in opening destination directory");
+			close(fd_src);
+			return OPEN_ERROR;
+		}
+	}
 
-	if (close(fd_src) < 0) {
+	file->fd = openat(file->dirfd, ".", O_TMPFILE | O_WRONLY | O_CLOEXEC, st.st_mode & 07777);
+	if (file->fd < 0 && (errno == EOPNOTSUPP || errno == EISDIR || errno == EINVAL)) {
+		// no O_TMPFILE on this file system, a hidden name is the next best thing
+		temp_name(file->tmp_name, file->name);
+		file->fd = openat(file->dirfd, file->tmp_name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 07777);
+	}
+	if (file->fd < 0) {
+		perror("Error in opening or creating destination file");
+		if (file->own_dirfd) {
+			close(file->dirfd);
+		}
+		close(fd_src);
+		return OPEN_ERROR;
+	}
+
+	struct copy_stats file_stats;
+	int ret = copy_fd(fd_src, file->fd, NULL, &file_stats);
+	if (close(fd_src) < 0 && ret == 0) {
 		perror("Error in closing source file descriptor");
-		exit(CLOSE_ERROR);
+		ret = CLOSE_ERROR;
+	}
+	if (ret == 0) {
+		// --sync=file flushes it now, batch starts its writeback
+		ret = sync_written(file->fd, batch->sync, &file_stats);
 	}
-	if (close(fd_dest) < 0) {
-		perror("Error in closing destination file descriptor");
-		exit(CLOSE_ERROR);
+	if (ret < 0) {
+		drop_pending(file);
+		return ret;
 	}
+	copy_stats_add(stats, &file_stats);
+
+	if (++batch->count == MOVE_BATCH) {
+		return flush_moves(prog, batch, stats);
+	}
+	return 0;
+}
 
-	if( unlink(argv[1]) < 0) {
+// a symlink to another file system: the link itself is made again, never a copy of what it
+// points to, under a temporary name renamed over the destination, and then the source goes
+static int move_link(const char* prog, int src_dirfd, char* src_name, char* src_path, int dest_dirfd, char* dest_name,
+	enum sync_policy sync, struct copy_stats* stats) {
+	char target[PATH_MAX];
+	ssize_t len = readlinkat(src_dirfd, src_name, target, sizeof(target) - 1);
+	if (len < 0) {
+		fprintf(stderr, "%s: cannot read link '%s': %s\n", prog, src_path, strerror(errno));
+		return READ_ERROR;
+	}
+	target[len] = '\0';
+
+	char dir[PATH_MAX];
+	char dest_path[PATH_MAX];
+	snprintf(dest_path, sizeof(dest_path), "%s", dest_name);
+	char* name = split_path(dest_path, dir);
+	int dirfd = dest_dirfd;
+	int own_dirfd = dir[0] != '\0' || dest_dirfd == AT_FDCWD;
+	if (own_dirfd) {
+		// the directory is needed as an fd to fsync it
+		dirfd = openat(dest_dirfd, dir[0] != '\0' ? dir : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (dirfd < 0) {
+			perror("Error in opening destination directory");
+			return OPEN_ERROR;
+		}
+	}
+
+	int ret = 0;
+	char tmp[NAME_MAX + 1];
+	temp_name(tmp, name);
+	if (symlinkat(target, dirfd, tmp) < 0) {
+		fprintf(stderr, "%s: cannot create '%s': %s\n", prog, dest_name, strerror(errno));
+		ret = WRITE_ERROR;
+	}
+	else if (renameat(dirfd, tmp, dirfd, name) < 0) {
+		fprintf(stderr, "%s: cannot create '%s': %s\n", prog, dest_name, strerror(errno));
+		unlinkat(dirfd, tmp, 0);
+		ret = WRITE_ERROR;
+	}
+	else if (sync != SYNC_NONE) {
+		// the new link has to be on disk before the source loses its own
+		if (fsync(dirfd) < 0) {
+			perror("Error in flushing the destination directory");
+			ret = WRITE_ERROR;
+		}
+		copy_count_call(stats, CALL_SYNC);
+	}
+	if (own_dirfd) {
+		close(dirfd);
+	}
+
+	if (ret == 0 && unlinkat(src_dirfd, src_name, 0) < 0) {
 		perror("Error in deleting the source file");
-		exit(UNLINK_ERROR);
+		ret = UNLINK_ERROR;
+	}
+	return ret;
+}
+
+// move src_name (in src_dirfd, src_path for messages) to dest_name in dest_dirfd,
+// with a single renameat2 when both are on the same file system
+static int move_one(const char* prog, int src_dirfd, char* src_name, char* src_path, int dest_dirfd, char* dest_dir, char* dest_name,
+	struct move_batch* batch, struct copy_stats* stats, unsigned long long* files) {
+	if (renameat2(src_dirfd, src_name, dest_dirfd, dest_name, 0) == 0) {
+		stats->strategy = COPY_RENAME;
+		(*files)++;
+		return 0;
+	}
+	if (errno != EXDEV) {
+		int err = errno;
+		fprintf(stderr, "%s: cannot move '%s': %s\n", prog, src_path, strerror(err));
+		return err == ENOENT ? OPEN_ERROR : WRITE_ERROR;
+	}
+
+	// a directory can only go to another file system as a copy of the whole tree,
+	// a symlink is moved as a link whatever it points to
+	struct stat st;
+	if (fstatat(src_dirfd, src_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+		fprintf(stderr, "%s: cannot stat '%s': %s\n", prog, src_path, strerror(errno));
+		return OPEN_ERROR;
+	}
+	if (S_ISDIR(st.st_mode)) {
+		return move_tree(prog, src_path, dest_dirfd, dest_dir, dest_name, batch->sync, batch->engine, stats, files);
+	}
+	if (S_ISLNK(st.st_mode)) {
+		int ret = move_link(prog, src_dirfd, src_name, src_path, dest_dirfd, dest_name, batch->sync, stats);
+		if (ret == 0) {
+			(*files)++;
+		}
+		return ret;
 	}
+	int ret = move_file(prog, src_dirfd, src_name, src_path, dest_dirfd, dest_name, batch, stats);
+	if (ret == 0) {
+		(*files)++;
+	}
+	return ret;
+}
 
+
+// mv SOURCE... DIRECTORY, and mv SOURCE DIRECTORY when the directory exists:
+// the target is opened once and every source is renamed relative to it
+static int move_all(const char* prog, char* srcs[], int count, char* dest, enum sync_policy sync,
+	enum copy_engine engine, struct copy_stats* stats, unsigned long long* files) {
+	int dest_fd = open(dest, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dest_fd < 0 && count > 1) {
+		fprintf(stderr, "%s: target '%s': %s\n", prog, dest, strerror(errno));
+		return OPEN_ERROR;
+	}
+
+	struct dir_cache cache = {0};
+	struct move_batch batch;
+	batch.count = 0;
+	batch.sync = sync;
+	batch.engine = engine;
+	int error = 0;
+	for (int i = 0; i < count; i++) {
+		char dir[PATH_MAX];
+		char* name = split_path(srcs[i], dir);
+		int src_dirfd = cached_dirfd(&cache, dir);
+		if (src_dirfd == -1) {
+			fprintf(stderr, "%s: cannot stat '%s': %s\n", prog, srcs[i], strerror(errno));
+			if (error == 0) {
+				error = OPEN_ERROR;
+			}
+			continue;
+		}
+
+		int ret;
+		if (dest_fd >= 0) {
+			ret = move_one(prog, src_dirfd, name, srcs[i], dest_fd, dest, name, &batch, stats, files);
+		}
+		else {
+			ret = move_one(prog, src_dirfd, name, srcs[i], AT_FDCWD, "", dest, &batch, stats, files);
+		}
+		if (ret < 0 && error == 0) {
+			error = ret;
+		}
+	}
+	int ret = flush_moves(prog, &batch, stats);
+	if (ret < 0 && error == 0) {
+		error = ret;
+	}
+	close_dirs(&cache);
+	if (dest_fd >= 0) {
+		close(dest_fd);
+	}
+	return error;
+}
+
+
+int fileops_move(const char* prog, const char* src, const char* dest, const struct copy_options* opts, struct copy_stats* stats) {
+	struct copy_stats local_stats = {0};
+	if (stats == NULL) {
+		stats = &local_stats;
+	}
+	// move_all cuts the trailing slashes off in place
+	char src_copy[PATH_MAX];
+	char dest_copy[PATH_MAX];
+	snprintf(src_copy, sizeof(src_copy), "%s", src);
+	snprintf(dest_copy, sizeof(dest_copy), "%s", dest);
+	char* srcs[1] = {src_copy};
+	unsigned long long files = 0;
+	return move_all(prog, srcs, 1, dest_copy, opts != NULL ? opts->sync : SYNC_FS, opts != NULL ? opts->engine : ENGINE_SYNC,
+		stats, &files);
+}
+
+
+// every option parse_options knows
+static const char* const mv_options[] = {"--stats", "--stats=", "--stats-file=", "--sync=", "--engine=", NULL};
+
+int fileops_mv_handles(int argc, char* argv[]) {
+	return fileops_knows_options(argc, argv, mv_options);
+}
+
+int fileops_mv(int argc, char* argv[]) {
+	// the options are moved out of a copy, the caller's argv stays as it was
+	char* args[argc + 1];
+	memcpy(args, argv, argc * sizeof(char*));
+	args[argc] = NULL;
+	argv = args;
+
+	struct copy_metrics metrics = {0};
+	struct copy_options opts = {0};
+	opts.sync = SYNC_FS;
+	int ret = parse_options(&argc, argv, &opts, &metrics);
+	if (ret < 0) {
+		return ret;
+	}
+	metrics_start(&metrics);
+
+	ret = fileops_check_operands(argc, argv);
+	if (ret < 0) {
+		return ret;
+	}
+
+	struct copy_stats stats = {0};
+	unsigned long long files = 0;
+	ret = move_all(argv[0], argv + 1, argc - 2, argv[argc - 1], opts.sync, opts.engine, &stats, &files);
+	if (ret < 0) {
+		return ret;
+	}
+	return metrics_report(&metrics, argv[0], files, &stats);
+}
+
+
+int mv_main(int argc, char *argv[]) {
+
+	int ret = fileops_mv(argc, argv);
+	if (ret < 0) {
+		exit(ret);
+	}
 	return 0;
 }
@@ -0,0 +1,75 @@
+#include <sys/uio.h>	// to use writev, struct iovec
+#include <stdio.h>	// to use fflush, stdout
+#include <string.h>	// to use memcpy, strlen
+#include <errno.h>	// to use errno, EINTR
+
+#include "outbuf.h"
+
+
+// write all iov[0..count), going on after a short write
+static int write_all(int fd, struct iovec* iov, int count) {
+	while (count > 0) {
+		ssize_t num_bytes_written = writev(fd, iov, count);
+		if (num_bytes_written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		while (count > 0 && (size_t)num_bytes_written >= iov->iov_len) {
+			num_bytes_written -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count > 0) {
+			iov->iov_base = (char*)iov->iov_base + num_bytes_written;
+			iov->iov_len -= num_bytes_written;
+		}
+	}
+	return 0;
+}
+
+// the shells mix the builtins' output with printf on the same fd
+static void flush_stdio(int fd) {
+	if (fd == 1) {
+		fflush(stdout);
+	}
+}
+
+
+void out_init(struct out_buf* out, int fd) {
+	out->fd = fd;
+	out->len = 0;
+}
+
+int out_write(struct out_buf* out, const char* data, size_t len) {
+	if (out->len + len <= OUT_BUF_SIZE) {
+		memcpy(out->data + out->len, data, len);
+		out->len += len;
+		return 0;
+	}
+	flush_stdio(out->fd);
+	struct iovec iov[2];
+	iov[0].iov_base = out->data;
+	iov[0].iov_len = out->len;
+	iov[1].iov_base = (char*)data;
+	iov[1].iov_len = len;
+	out->len = 0;
+	return write_all(out->fd, iov, 2);
+}
+
+int out_str(struct out_buf* out, const char* str) {
+	return out_write(out, str, strlen(str));
+}
+
+int out_flush(struct out_buf* out) {
+	if (out->len == 0) {
+		return 0;
+	}
+	flush_stdio(out->fd);
+	struct iovec iov;
+	iov.iov_base = out->data;
+	iov.iov_len = out->len;
+	out->len = 0;
+	return write_all(out->fd, &iov, 1);
+}
@@ -0,0 +1,28 @@
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include <stddef.h>	// to use size_t
+
+#define OUT_BUF_SIZE 8192
+
+// output of a builtin gathered in user space and written with as few syscalls as possible:
+// small pieces are copied into data, a piece that doesn't fit goes out in the same
+// writev as what was already buffered, and out_flush writes the rest at the end of the command
+// a builtin keeps its out_buf on its stack and flushes it before returning, so nothing is
+// left behind when the shell then forks or changes its redirections
+struct out_buf {
+	int fd;
+	size_t len;
+	char data[OUT_BUF_SIZE];
+};
+
+void out_init(struct out_buf* out, int fd);
+
+// 0, or -1 with errno set when the fd can't be written
+int out_write(struct out_buf* out, const char* data, size_t len);
+int out_str(struct out_buf* out, const char* str);
+
+// write everything that is buffered, what was printf'ed to stdout before goes out first
+int out_flush(struct out_buf* out);
+
+#endif
@@ -1,8 +1,9 @@
 #include <unistd.h>    // for getcwd
 #include <stdlib.h>    // for exit, free
-#include <string.h>    // for strlen
 #include <stdio.h>     // for perror
 
+#include "outbuf.h"    // for out_init, out_str, out_write, out_flush
+
 #define WRITE_ERROR    -1
 #define GETCWD_ERROR   -2
 int pwd_main() {
@@ -15,14 +16,10 @@ int pwd_main() {
         exit(GETCWD_ERROR);
     }
 
-    // Write the current directory followed by a newline
-    size_t len = strlen(cwd);
-    if (write(STDOUT_FILENO, cwd, len) != (ssize_t)len) {
-        perror("write");
-        free(cwd);
-        exit(WRITE_ERROR);
-    }
-    if (write(STDOUT_FILENO, "\n", 1) != 1) {
+    // Write the current directory followed by a newline, in one write
+    struct out_buf out;
+    out_init(&out, 1);
+    if (out_str(&out, cwd) < 0 || out_write(&out, "\n", 1) < 0 || out_flush(&out) < 0) {
         perror("write");
         free(cwd);
         exit(WRITE_ERROR);
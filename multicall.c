@@ -0,0 +1,198 @@
+#define _POSIX_C_SOURCE 200809L	// to use clock_gettime
+#include <stdio.h>	// to use printf, fprintf, fopen, fgets
+#include <string.h>	// to use strcmp, strncmp, strrchr
+#include <stdlib.h>	// to use atoi, atol, exit
+#include <unistd.h>	// to use fork, execv, dup2, _exit
+#include <fcntl.h>	// to use open
+#include <sys/wait.h>	// to use waitpid
+#include <sys/ptrace.h>	// to use ptrace
+#include <signal.h>	// to use SIGTRAP
+#include <time.h>	// to use clock_gettime
+
+#define ARGUMENT_ERROR -1
+#define FORK_ERROR     -2
+
+#define MEASURE_RUNS 200	// --measure without a number
+
+// every command of the repository, linked into a single binary (busybox style)
+int cp_main(int argc, char *argv[]);
+int mv_main(int argc, char *argv[]);
+int echo_main(int argc, char *argv[]);
+int pwd_main();
+int femtoshell_main(int argc, char *argv[]);
+int picoshell_main(int argc, char *argv[]);
+int nanoshell_main(int argc, char *argv[]);
+int microshell_main(int argc, char *argv[]);
+
+static int pwd_applet(int argc, char *argv[]) {
+	(void)argc; (void)argv;
+	return pwd_main();
+}
+
+struct applet {
+	const char* name;
+	int (*main)(int argc, char *argv[]);
+};
+
+static const struct applet applets[] = {
+	{"cp", cp_main},
+	{"mv", mv_main},
+	{"echo", echo_main},
+	{"pwd", pwd_applet},
+	{"femtoshell", femtoshell_main},
+	{"picoshell", picoshell_main},
+	{"nanoshell", nanoshell_main},
+	{"microshell", microshell_main},
+};
+#define NUM_APPLETS (int)(sizeof(applets) / sizeof(applets[0]))
+
+
+static const struct applet* find_applet(const char* name) {
+	for (int i = 0; i < NUM_APPLETS; i++) {
+		if (strcmp(applets[i].name, name) == 0) {
+			return &applets[i];
+		}
+	}
+	return NULL;
+}
+
+static void usage(const char* prog) {
+	fprintf(stderr, "usage: %s APPLET [ARG]...   (or run it through a link named after the applet)\n", prog);
+	fprintf(stderr, "       %s --measure[=RUNS]  start every applet RUNS times, report its startup time and peak size\n", prog);
+	fprintf(stderr, "applets:");
+	for (int i = 0; i < NUM_APPLETS; i++) {
+		fprintf(stderr, " %s", applets[i].name);
+	}
+	fprintf(stderr, "\n");
+}
+
+static double now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// the child side of a measured run: the applet with nothing to do (no operands, stdin
+// at EOF, no output), which is what a job runner pays per command before any real work
+static void exec_applet(const struct applet* applet, int traced) {
+	int null_fd = open("/dev/null", O_RDWR);
+	dup2(null_fd, 0);
+	dup2(null_fd, 1);
+	dup2(null_fd, 2);
+	if (traced) {
+		ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+	}
+	char* argv[] = {(char*)applet->name, NULL};
+	execv("/proc/self/exe", argv);
+	_exit(127);
+}
+
+// peak resident size of one run in KiB: ru_maxrss can't be used, it also counts the
+// copy of this process that the child was before exec, so the child is stopped right
+// before it exits (PTRACE_O_TRACEEXIT) and its VmHWM is read while it still has its memory
+static long peak_rss(const struct applet* applet) {
+	pid_t pid = fork();
+	if (pid < 0) {
+		return -1;
+	}
+	if (pid == 0) {
+		exec_applet(applet, 1);
+	}
+	long rss = -1;
+	int status;
+	while (waitpid(pid, &status, 0) == pid && WIFSTOPPED(status)) {
+		int sig = WSTOPSIG(status);
+		if (sig == SIGTRAP && (status >> 16) == 0) {
+			// stopped by the exec
+			ptrace(PTRACE_SETOPTIONS, pid, NULL, (void*)PTRACE_O_TRACEEXIT);
+			sig = 0;
+		}
+		else if (sig == SIGTRAP && (status >> 16) == PTRACE_EVENT_EXIT) {
+			char path[64];
+			char line[256];
+			snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+			FILE* file = fopen(path, "r");
+			while (file != NULL && fgets(line, sizeof(line), file) != NULL) {
+				if (strncmp(line, "VmHWM:", 6) == 0) {
+					rss = atol(line + 6);
+				}
+			}
+			if (file != NULL) {
+				fclose(file);
+			}
+			sig = 0;
+		}
+		ptrace(PTRACE_CONT, pid, NULL, (void*)(long)sig);
+	}
+	return rss;
+}
+
+// start every applet runs times: the time from fork to the end of wait, then one more
+// (traced, so not timed) run for the peak resident size
+static int measure(int runs) {
+	printf("%-12s %10s %10s %12s\n", "applet", "mean us", "min us", "peak RSS KiB");
+	for (int i = 0; i < NUM_APPLETS; i++) {
+		double total = 0;
+		double best = 0;
+		for (int run = 0; run < runs; run++) {
+			double start = now_us();
+			pid_t pid = fork();
+			if (pid < 0) {
+				perror("Error in fork");
+				return FORK_ERROR;
+			}
+			if (pid == 0) {
+				exec_applet(&applets[i], 0);
+			}
+			int status;
+			if (waitpid(pid, &status, 0) < 0) {
+				perror("Error in wait");
+				return FORK_ERROR;
+			}
+			double elapsed = now_us() - start;
+			total += elapsed;
+			if (run == 0 || elapsed < best) {
+				best = elapsed;
+			}
+		}
+		printf("%-12s %10.1f %10.1f %12ld\n", applets[i].name, total / runs, best, peak_rss(&applets[i]));
+	}
+	return 0;
+}
+
+
+int main(int argc, char *argv[]) {
+
+	// called through a link: the name of the link is the applet
+	const char* name = strrchr(argv[0], '/');
+	name = name != NULL ? name + 1 : argv[0];
+	const struct applet* applet = find_applet(name);
+	if (applet != NULL) {
+		return applet->main(argc, argv);
+	}
+
+	// called by its own name: the first argument is the applet
+	if (argc < 2) {
+		usage(argv[0]);
+		exit(ARGUMENT_ERROR);
+	}
+	if (strcmp(argv[1], "--measure") == 0 || strncmp(argv[1], "--measure=", 10) == 0) {
+		int runs = argv[1][9] == '=' ? atoi(argv[1] + 10) : MEASURE_RUNS;
+		if (runs <= 0) {
+			usage(argv[0]);
+			exit(ARGUMENT_ERROR);
+		}
+		int ret = measure(runs);
+		if (ret < 0) {
+			exit(ret);
+		}
+		return 0;
+	}
+	applet = find_applet(argv[1]);
+	if (applet == NULL) {
+		fprintf(stderr, "%s: unknown applet '%s'\n", argv[0], argv[1]);
+		usage(argv[0]);
+		exit(ARGUMENT_ERROR);
+	}
+	return applet->main(argc - 1, argv + 1);
+}
@@ -0,0 +1,64 @@
+#include <stdlib.h>	// to use malloc, free
+#include <stdio.h>	// to use perror
+
+#include "arena.h"
+
+#define ARENA_ALIGN _Alignof(max_align_t)
+
+
+void arena_init(struct arena* arena) {
+	arena->head = NULL;
+	arena->current = NULL;
+}
+
+void* arena_alloc(struct arena* arena, size_t size) {
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	struct arena_block* block = arena->current;
+	struct arena_block* last = NULL;
+	while (block != NULL && block->size - block->used < size) {
+		// the blocks after current were left by an earlier (bigger) command, they are empty now
+		last = block;
+		block = block->next;
+		if (block != NULL) {
+			block->used = 0;
+		}
+	}
+	if (block == NULL) {
+		size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+		block = (struct arena_block*)malloc(sizeof(struct arena_block) + block_size);
+		if (block == NULL) {
+			perror("Unable to allocate memory");
+			return NULL;
+		}
+		block->next = NULL;
+		block->size = block_size;
+		block->used = 0;
+		if (last == NULL) {
+			arena->head = block;
+		}
+		else {
+			last->next = block;
+		}
+	}
+	arena->current = block;
+	void* ptr = block->data + block->used;
+	block->used += size;
+	return ptr;
+}
+
+void arena_reset(struct arena* arena) {
+	arena->current = arena->head;
+	if (arena->head != NULL) {
+		arena->head->used = 0;
+	}
+}
+
+void arena_free(struct arena* arena) {
+	struct arena_block* block = arena->head;
+	while (block != NULL) {
+		struct arena_block* next = block->next;
+		free(block);
+		block = next;
+	}
+	arena_init(arena);
+}
@@ -0,0 +1,31 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>	// to use size_t, max_align_t
+
+#define ARENA_BLOCK_SIZE (64 * 1024)	// a bigger allocation gets a block of its own size
+
+// bump allocator for everything a shell needs while it runs one command (the tokens,
+// the expanded words): an allocation moves a pointer forward and nothing is freed one by
+// one, arena_reset makes all of it free again at once and keeps the blocks for the next command
+struct arena_block {
+	struct arena_block* next;
+	size_t size;
+	size_t used;
+	_Alignas(max_align_t) char data[];
+};
+
+struct arena {
+	struct arena_block* head;
+	struct arena_block* current;
+};
+
+void arena_init(struct arena* arena);
+
+// size bytes aligned for any type, NULL (after a perror) when no block can be allocated
+void* arena_alloc(struct arena* arena, size_t size);
+
+void arena_reset(struct arena* arena);
+void arena_free(struct arena* arena);
+
+#endif
@@ -2,6 +2,8 @@
 #include <stdlib.h>		// to use exit
 #include <string.h>		// to use strcspn, strtok
 
+#include "outbuf.h"		// to use out_init, out_write, out_str, out_flush (Assignment part 8)
+
 #define BUFFER_SIZE 10240
 #define READ_ERROR -1
 
@@ -36,17 +38,25 @@ int femtoshell_main(int argc, char *argv[]) {
 			break;
 		}
 		else if (strcmp(command, "echo") == 0) {
+			// the whole line goes out with one write (after what printf still holds)
+			struct out_buf out;
+			out_init(&out, 1);
+			int ret = 0;
 			char* argument = strtok(NULL, " "); // get next token
 			while (argument != NULL) {
-				printf("%s", argument);
+				ret |= out_str(&out, argument);
 				char* next_argument = strtok(NULL, " "); // get next token
 				if (next_argument != NULL) {
-					printf(" ");
+					ret |= out_write(&out, " ", 1);
 				}
 				argument = next_argument;
 			}
-			printf("\n");
-			last_status=0; // echo succeeded
+			ret |= out_write(&out, "\n", 1);
+			ret |= out_flush(&out);
+			if (ret < 0) {
+				perror("Error in writing to stdout");
+			}
+			last_status = ret < 0 ? 1 : 0; // echo succeeded unless a write failed
 		}
 		else {
 			printf("Invalid command\n");
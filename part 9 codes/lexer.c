@@ -0,0 +1,212 @@
+#include <stdio.h>	// to use fprintf, stderr
+#include <string.h>	// to use memcpy
+
+#include "lexer.h"
+
+static const char* const operator_names[] = {"", "<", ">", "2>", "|", "&"};
+
+
+// room for one more token (and the NULL after the last one), the vectors double
+// in the arena so a command of n tokens copies less than 2n of them in total
+static int grow_tokens(struct lexer* lexer) {
+	if (lexer->argc + 1 < lexer->capacity) {
+		return 0;
+	}
+	int capacity = lexer->capacity == 0 ? 64 : 2 * lexer->capacity;
+	char** argv = (char**)arena_alloc(lexer->arena, capacity * sizeof(char*));
+	enum token_kind* kinds = (enum token_kind*)arena_alloc(lexer->arena, capacity * sizeof(enum token_kind));
+	if (argv == NULL || kinds == NULL) {
+		return LEX_MALLOC_ERROR;
+	}
+	if (lexer->argc > 0) {
+		memcpy(argv, lexer->argv, lexer->argc * sizeof(char*));
+		memcpy(kinds, lexer->kinds, lexer->argc * sizeof(enum token_kind));
+	}
+	lexer->argv = argv;
+	lexer->kinds = kinds;
+	lexer->capacity = capacity;
+	return 0;
+}
+
+static int add_operator(struct lexer* lexer, enum token_kind kind, unsigned int operators) {
+	if ((operators & TOKEN_MASK(kind)) == 0) {
+		fprintf(stderr, "`%s' is not supported by this shell\n", operator_names[kind]);
+		return LEX_ERROR;
+	}
+	if (grow_tokens(lexer) < 0) {
+		return LEX_MALLOC_ERROR;
+	}
+	lexer->argv[lexer->argc] = (char*)operator_names[kind];
+	lexer->kinds[lexer->argc++] = kind;
+	return 0;
+}
+
+static int is_blank(char c) {
+	return c == ' ' || c == '\t';
+}
+
+static int is_operator(char c) {
+	return c == '<' || c == '>' || c == '|' || c == '&' || c == ';';
+}
+
+static int is_name_start(char c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static int is_name_char(char c) {
+	return is_name_start(c) || (c >= '0' && c <= '9');
+}
+
+// the word being written: it starts at word, out is where the next byte goes
+struct word_buf {
+	char* word;
+	char* out;
+	char* end;
+};
+
+// line[*i] is a '$': $NAME is replaced by the value of the variable (by nothing when it isn't
+// set), a '$' that doesn't start a name is kept, like every '$' when there are no variables
+static int expand(struct lexer* lexer, struct word_buf* wb, const char* line, size_t len, size_t* i) {
+	size_t start = *i + 1;
+	if (lexer->lookup == NULL || start >= len || !is_name_start(line[start])) {
+		*wb->out++ = line[(*i)++];
+		return 0;
+	}
+	size_t end = start + 1;
+	while (end < len && is_name_char(line[end])) {
+		end++;
+	}
+	*i = end;
+	size_t value_len = 0;
+	const char* value = lexer->lookup(lexer->ctx, line + start, end - start, &value_len);
+	if (value == NULL) {
+		return 0;
+	}
+	// a value can be longer than $NAME: when the rest of the line (2 bytes per character at
+	// most) wouldn't fit after it anymore, the word moves to a bigger buffer of the arena
+	size_t rest = 2 * (len - end) + 1;
+	if ((size_t)(wb->end - wb->out) < value_len + rest) {
+		size_t done = wb->out - wb->word;
+		size_t size = 2 * (done + value_len) + rest;
+		char* buf = (char*)arena_alloc(lexer->arena, size);
+		if (buf == NULL) {
+			return LEX_MALLOC_ERROR;
+		}
+		memcpy(buf, wb->word, done);
+		wb->word = buf;
+		wb->out = buf + done;
+		wb->end = buf + size;
+		lexer->argv[lexer->argc - 1] = buf;
+	}
+	memcpy(wb->out, value, value_len);
+	wb->out += value_len;
+	return 0;
+}
+
+
+void lexer_init(struct lexer* lexer, struct arena* arena, lexer_lookup lookup, void* ctx) {
+	lexer->arena = arena;
+	lexer->lookup = lookup;
+	lexer->ctx = ctx;
+	lexer->argv = NULL;
+	lexer->kinds = NULL;
+	lexer->argc = 0;
+	lexer->capacity = 0;
+}
+
+int lexer_split(struct lexer* lexer, const char* line, size_t len, unsigned int operators, size_t* used) {
+	// without expansions a word is never longer than its text and each one adds a '\0', so
+	// 2 * len + 1 bytes always fit: only an expanded value has to check for room
+	struct word_buf wb;
+	wb.out = (char*)arena_alloc(lexer->arena, 2 * len + 1);
+	if (wb.out == NULL) {
+		return LEX_MALLOC_ERROR;
+	}
+	wb.end = wb.out + 2 * len + 1;
+	lexer->argv = NULL;
+	lexer->kinds = NULL;
+	lexer->argc = 0;
+	lexer->capacity = 0;
+	if (grow_tokens(lexer) < 0) {
+		return LEX_MALLOC_ERROR;
+	}
+	lexer->argv[0] = NULL;
+
+	size_t i = 0;
+	while (i < len && line[i] != ';') {
+		if (is_blank(line[i])) {
+			i++;
+			continue;
+		}
+		int ret = 0;
+		if (line[i] == '2' && i + 1 < len && line[i + 1] == '>') {
+			ret = add_operator(lexer, TOKEN_ERR_OUT, operators);
+			i += 2;
+		}
+		else if (line[i] == '<' || line[i] == '>' || line[i] == '|' || line[i] == '&') {
+			enum token_kind kind = line[i] == '<' ? TOKEN_IN : line[i] == '>' ? TOKEN_OUT : line[i] == '|' ? TOKEN_PIPE : TOKEN_AMP;
+			ret = add_operator(lexer, kind, operators);
+			i++;
+		}
+		else {
+			// a word, up to a blank or an operator that isn't quoted
+			if (grow_tokens(lexer) < 0) {
+				return LEX_MALLOC_ERROR;
+			}
+			wb.word = wb.out;
+			lexer->argv[lexer->argc] = wb.word;
+			lexer->kinds[lexer->argc++] = TOKEN_WORD;
+			int quoted = 0;
+			while (ret == 0 && i < len && !is_blank(line[i]) && !is_operator(line[i])) {
+				char c = line[i];
+				if (c == '\\') {
+					quoted = 1;
+					i++;
+					if (i < len) {
+						*wb.out++ = line[i++];
+					}
+				}
+				else if (c == '$') {
+					ret = expand(lexer, &wb, line, len, &i);
+				}
+				else if (c == '\'' || c == '"') {
+					quoted = 1;
+					i++;
+					while (ret == 0 && i < len && line[i] != c) {
+						if (c == '"' && line[i] == '\\' && i + 1 < len
+							&& (line[i + 1] == '"' || line[i + 1] == '\\' || line[i + 1] == '$')) {
+							i++;
+							*wb.out++ = line[i++];
+						}
+						else if (c == '"' && line[i] == '$') {
+							ret = expand(lexer, &wb, line, len, &i);
+						}
+						else {
+							*wb.out++ = line[i++];
+						}
+					}
+					if (ret == 0 && i == len) {
+						fprintf(stderr, "unexpected EOF while looking for matching `%c'\n", c);
+						return LEX_ERROR;
+					}
+					i++; // the closing quote
+				}
+				else {
+					*wb.out++ = line[i++];
+				}
+			}
+			if (!quoted && wb.out == wb.word) {
+				lexer->argc--; // $EMPTY alone: no word, like "echo $nothing x" gives one argument
+			}
+			else {
+				*wb.out++ = '\0';
+			}
+		}
+		if (ret < 0) {
+			return ret;
+		}
+	}
+	lexer->argv[lexer->argc] = NULL;
+	*used = i < len ? i + 1 : len; // with the ';'
+	return 0;
+}
@@ -0,0 +1,52 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stddef.h>	// to use size_t
+
+#include "arena.h"	// to use struct arena
+
+#define LEX_ERROR        -1	// the line can't be split (unclosed quote, operator not supported...)
+#define LEX_MALLOC_ERROR -2
+
+enum token_kind {
+	TOKEN_WORD,
+	TOKEN_IN,	// <
+	TOKEN_OUT,	// >
+	TOKEN_ERR_OUT,	// 2>
+	TOKEN_PIPE,	// |
+	TOKEN_AMP,	// &
+};
+
+#define TOKEN_MASK(kind) (1u << (kind))
+
+// the value of the variable name[0..name_len) and its length, NULL when it isn't set
+typedef const char* (*lexer_lookup)(void* ctx, const char* name, size_t name_len, size_t* value_len);
+
+// the tokens of one command: argv[0..argc) (NULL terminated, ready for execvp) and the kind
+// of each one, an operator has its spelling in argv, a quoted "<" is a TOKEN_WORD
+// the words and both vectors are taken from the arena of the command, so they are
+// valid until that arena is reset and nothing of them has to be freed
+struct lexer {
+	struct arena* arena;
+	lexer_lookup lookup;	// NULL when the shell has no variables, '$' is then kept as it is
+	void* ctx;		// passed to lookup
+	char** argv;
+	enum token_kind* kinds;
+	int argc;
+	int capacity;
+};
+
+void lexer_init(struct lexer* lexer, struct arena* arena, lexer_lookup lookup, void* ctx);
+
+// split the command at the start of line[0..len) in one pass: blanks (spaces, tabs) separate
+// the words, '...' keeps everything, "..." keeps everything but \" \\ \$, \ outside quotes
+// keeps the next character, and a ';' ends the command, *used is then what was taken of line
+// (with the ';') so the next command starts at line + *used
+// $NAME outside quotes and in "..." is replaced by the value of the variable while the word
+// is written (the quotes still apply to it), a '$' in '...' or after a \ stays a '$', and an
+// unquoted word that expands to nothing isn't a word at all
+// operators is the TOKEN_MASK of the operators the shell can run, any other one is an error
+// returns 0, LEX_ERROR after a message on stderr or LEX_MALLOC_ERROR
+int lexer_split(struct lexer* lexer, const char* line, size_t len, unsigned int operators, size_t* used);
+
+#endif
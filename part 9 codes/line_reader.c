@@ -0,0 +1,152 @@
+#include <stdlib.h>	// to use malloc, realloc, free
+#include <stdio.h>	// to use perror
+#include <string.h>	// to use memchr, memmove, memcpy, strlen, strcmp, strerror
+#include <unistd.h>	// to use read, close
+#include <fcntl.h>	// to use open
+#include <errno.h>	// to use errno, EINTR
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>	// to use _mm_cmpeq_epi8, _mm_movemask_epi8 (and the _mm256_ ones)
+#endif
+
+#include "line_reader.h"
+
+
+// position of the first '\n' in p[0..len) or len, 32 or 16 bytes are compared at once
+// and the mask of the matches gives the position, the tail shorter than a vector goes to memchr
+static size_t find_newline(const char* p, size_t len) {
+	size_t i = 0;
+#if defined(__AVX2__)
+	const __m256i newline = _mm256_set1_epi8('\n');
+	for (; i + 32 <= len; i += 32) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i*)(p + i));
+		unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline));
+		if (mask != 0) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+#elif defined(__SSE2__)
+	const __m128i newline = _mm_set1_epi8('\n');
+	for (; i + 16 <= len; i += 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i*)(p + i));
+		unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+		if (mask != 0) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+#endif
+	const char* found = memchr(p + i, '\n', len - i);
+	return found != NULL ? (size_t)(found - p) : len;
+}
+
+// room for at least LINE_READ_SIZE more bytes after end: the consumed lines are
+// dropped from the front first, the buffer only doubles when a single line fills it
+static int make_room(struct line_reader* reader) {
+	if (reader->start > 0) {
+		memmove(reader->buf, reader->buf + reader->start, reader->end - reader->start);
+		reader->end -= reader->start;
+		reader->start = 0;
+	}
+	if (reader->size > 0 && reader->size - 1 - reader->end >= LINE_READ_SIZE) {
+		return 0;
+	}
+	size_t size = reader->size == 0 ? LINE_READ_SIZE + 1 : 2 * reader->size;
+	char* new_buf = (char*)realloc(reader->buf, size);
+	if (new_buf == NULL) {
+		perror("Unable to reallocate buffer");
+		return -1;
+	}
+	reader->buf = new_buf;
+	reader->size = size;
+	return 0;
+}
+
+
+void line_reader_init(struct line_reader* reader, int fd) {
+	reader->fd = fd;
+	reader->buf = NULL;
+	reader->size = 0;
+	reader->start = 0;
+	reader->scanned = 0;
+	reader->end = 0;
+	reader->eof = 0;
+	reader->own_fd = 0;
+}
+
+int line_reader_from_args(struct line_reader* reader, int argc, char* argv[]) {
+	line_reader_init(reader, STDIN_FILENO);
+	if (argc < 2) {
+		return 1;
+	}
+	if (strcmp(argv[1], "-c") == 0) {
+		if (argc < 3) {
+			fprintf(stderr, "%s: -c: option requires an argument\n", argv[0]);
+			return -1;
+		}
+		// the whole input is already there: the string is the buffer and the end is reached
+		size_t len = strlen(argv[2]);
+		reader->buf = (char*)malloc(len + 1);
+		if (reader->buf == NULL) {
+			perror("Unable to allocate buffer");
+			return -1;
+		}
+		memcpy(reader->buf, argv[2], len);
+		reader->size = len + 1;
+		reader->end = len;
+		reader->eof = 1;
+		reader->fd = -1;
+		return 0;
+	}
+	// the script's fd isn't left open in the commands the shell runs
+	int fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s: %s\n", argv[0], argv[1], strerror(errno));
+		return -1;
+	}
+	reader->fd = fd;
+	reader->own_fd = 1;
+	return 0;
+}
+
+char* line_reader_next(struct line_reader* reader, size_t* len) {
+	while (1) {
+		size_t from = reader->start + reader->scanned;
+		size_t pos = from < reader->end ? from + find_newline(reader->buf + from, reader->end - from) : reader->end;
+		if (pos < reader->end || (reader->eof && pos > reader->start)) {
+			// a whole line, or the last one that has no '\n'
+			char* line = reader->buf + reader->start;
+			reader->buf[pos] = '\0';
+			*len = pos - reader->start;
+			reader->start = pos < reader->end ? pos + 1 : pos;
+			reader->scanned = 0;
+			return line;
+		}
+		if (reader->eof) {
+			return NULL;
+		}
+		reader->scanned = reader->end - reader->start;
+
+		if (make_room(reader) < 0) {
+			return NULL;
+		}
+		ssize_t num_bytes_read = read(reader->fd, reader->buf + reader->end, reader->size - 1 - reader->end);
+		if (num_bytes_read < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("Error in reading input");
+			return NULL;
+		}
+		if (num_bytes_read == 0) {
+			reader->eof = 1;
+		}
+		reader->end += num_bytes_read;
+	}
+}
+
+void line_reader_free(struct line_reader* reader) {
+	free(reader->buf);
+	if (reader->own_fd) {
+		close(reader->fd);
+	}
+	line_reader_init(reader, STDIN_FILENO);
+}
@@ -0,0 +1,36 @@
+#ifndef LINE_READER_H
+#define LINE_READER_H
+
+#include <stddef.h>	// to use size_t
+
+#define LINE_READ_SIZE (64 * 1024)	// bytes asked from read at once, the buffer grows only for longer lines
+
+// the input of a shell read in big blocks into one reusable buffer: a line is handed out
+// as a view into that buffer (its '\n' replaced by '\0'), so there is no malloc per line
+// the block read also takes the lines after the current one, like stdio did before,
+// so a command run by the shell doesn't see the rest of a piped script on its stdin
+struct line_reader {
+	int fd;
+	char* buf;
+	size_t size;	// allocated bytes, one more than the data can use for the '\0'
+	size_t start;	// first byte of the next line
+	size_t scanned;	// bytes after start already known to have no '\n'
+	size_t end;	// end of the data read so far
+	int eof;
+	int own_fd;	// opened by line_reader_from_args, closed by line_reader_free
+};
+
+void line_reader_init(struct line_reader* reader, int fd);
+
+// where a shell takes its commands from: "shell" reads stdin, "shell script.sh" the file
+// and "shell -c cmds" the string; 1 for stdin (the shell shows its prompt), 0 for a
+// script or a string (no prompt at all) and -1 after a message when argv can't be used
+int line_reader_from_args(struct line_reader* reader, int argc, char* argv[]);
+
+// the next line without its '\n', valid (and writable) until the next call,
+// NULL at the end of the input or when reading fails (after a perror)
+char* line_reader_next(struct line_reader* reader, size_t* len);
+
+void line_reader_free(struct line_reader* reader);
+
+#endif
@@ -1,6 +1,6 @@
-#include <stdlib.h>	// to use malloc, realloc, exit, getenv, putenv
-#include <stdio.h>	// to use getchar, EOF, perror, fflush, fprintf, stderr
-#include <string.h>	// to use strlen, strtok, strcmp, strchr, strcpy, strncpy
+#include <stdlib.h>	// to use exit, getenv
+#include <stdio.h>	// to use perror, fflush, fprintf, stderr
+#include <string.h>	// to use strlen, strcmp, strchr, memcpy
 #include <unistd.h>     // to use write, getcwd, fork, execvp, chdir, isatty, dup, dup2, close
 #include <sys/types.h>	// to use pid_t
 #include <sys/wait.h>	// to use wait
@@ -8,6 +8,13 @@
 #include <fcntl.h>	// to use open
 #include <stdbool.h>	// to use bool
 
+#include "fileops.h"	// to use fileops_cp, fileops_mv, fileops_cp_handles, fileops_mv_handles (Assignment part 8)
+#include "outbuf.h"	// to use out_init, out_write, out_str, out_flush (Assignment part 8)
+#include "line_reader.h"	// to use line_reader_init, line_reader_next, line_reader_free
+#include "arena.h"	// to use arena_init, arena_reset, arena_free, struct arena
+#include "lexer.h"	// to use lexer_init, lexer_split, struct lexer
+#include "var_store.h"	// to use var_store_new, var_store_get, var_store_set, var_store_export, var_store_free
+
 
 #define READ_ERROR 	-1
 #define WRITE_ERROR 	-2
@@ -26,98 +33,117 @@
 #define CLOSE_ERROR	-15
 
 
-#define MAX_ARGS 150
-
 
-char* read_line();
-int echo(int argc, char* argv[]);
-int pwd(int argc);
-int cd(int argc, char* argv[]);
-int matchesEqualPattern(char* str);
-int my_export(int argc, char* argv[], char** localVars, int lengthLocalVars);
-char* getValueByKey(char** localVars, int lengthLocalVars, char* requiredKey);
-char* replaceByPointers(char* pre_str, char* replace_start, char* post_str);
+static void restore_fds(int saved_stdin, int saved_stdout, int saved_stderr);
+static int echo(int argc, char* argv[]);
+static int pwd(int argc);
+static int cd(int argc, char* argv[]);
+static int matchesEqualPattern(char* str);
+static int my_export(int argc, char* argv[], struct var_store* localVars);
+static const char* lookup_var(void* localVars, const char* name, size_t name_len, size_t* value_len);
 
 
 int microshell_main(int argc, char *argv[]) {
 
 	int last_status = 0; // Track the last command status
 
-	int sizeLocalVars = 64; // initial array size
-	char** localVars = (char**)malloc(sizeLocalVars * sizeof(char*));
+	// local variables, key -> value in a hash table that updates a variable in place
+	struct var_store* localVars = var_store_new();
 	if (localVars == NULL) {
 		perror("Unable to allocate memory");
 		exit(MALLOC_ERROR);
 	}
-	int lengthLocalVars = 0;
 
 	// save stdin, stdout, stderr to restore after execution
 	int saved_stdin = dup(0);
 	int saved_stdout = dup(1);
 	int saved_stderr = dup(2);
 
+	// the commands come from stdin, a script file or -c, read in big blocks either way
+	struct line_reader input;
+	int show_prompt = line_reader_from_args(&input, argc, argv);
+	if (show_prompt < 0) {
+		exit(ARGUMENT_ERROR);
+	}
+	// the prompt and the newline after a line that isn't echoed by a terminal are
+	// only for stdin, and the terminal is checked once, not before every line
+	int echo_newline = show_prompt && !isatty(STDIN_FILENO);
+
+	// what is left of the line after a ';', the next command starts there
+	const char* pending = NULL;
+	size_t pending_len = 0;
+
+	// everything a command allocates (its words, the expanded ones) comes from the arena,
+	// which is reset before the next command instead of freeing every piece of it
+	struct arena arena;
+	arena_init(&arena);
+	struct lexer lexer;
+	lexer_init(&lexer, &arena, lookup_var, localVars);
+
 	while (1) {
-		int is_interactive = isatty(STDIN_FILENO);
+		if (pending_len == 0) {
+			if (show_prompt) {
+				printf("Micro shell prompt > ");
+				fflush(stdout);
+			}
 
-		printf("Micro shell prompt > ");
-		fflush(stdout);
+			size_t input_len;
+			char* input_line = line_reader_next(&input, &input_len); // a view into input, no free
+			if (input_line == NULL) {
+				if (show_prompt) {
+					printf("\n"); // mimic shell behavior on EOF
+				}
+				break;
+			}
 
-		char* input_line = read_line();
-		if (input_line == NULL) {
-			printf("\n"); // mimic shell behavior on EOF
-			break;
-		}
+			if (input_len == 0) {
+				if (echo_newline) {
+					printf("\n");
+				}
+				continue;
+			}
 
-		if (strlen(input_line) == 0) {
-			if (!is_interactive) {
+			if (echo_newline) {
 				printf("\n");
+				fflush(stdout);
 			}
-			free(input_line);
-			continue;
+
+			pending = input_line;
+			pending_len = input_len;
 		}
 
-		if (!is_interactive) {
-			printf("\n");
+		// the prompt's fflush was what wrote a command's printf output before the next one ran,
+		// a script or -c has no prompt so stdout is flushed here once per command
+		if (!show_prompt) {
 			fflush(stdout);
 		}
 
-		char* newArgv[MAX_ARGS];
-		int newArgc = 0;
-
-		char* token = strtok(input_line, " ");
-		while (token != NULL && newArgc < MAX_ARGS) {
-			newArgv[newArgc++] = token;
-			token = strtok(NULL, " ");
+		arena_reset(&arena);
+		size_t used = pending_len; // after an error the rest of the line is dropped
+		int lex_status = lexer_split(&lexer, pending, pending_len, TOKEN_MASK(TOKEN_IN) | TOKEN_MASK(TOKEN_OUT) | TOKEN_MASK(TOKEN_ERR_OUT), &used);
+		pending += used;
+		pending_len -= used;
+		if (lex_status == LEX_MALLOC_ERROR) {
+			exit(MALLOC_ERROR);
+		}
+		if (lex_status < 0) {
+			last_status = -1;
+			continue;
 		}
 
-		newArgv[newArgc] = NULL;
-
-		// check for $ and replace with variable value
-		for (int i = 0; i < newArgc; i++) {
-			char* replace_start = strchr(newArgv[i], '$');
-			if (replace_start != NULL) {
-				// $ found
-				char* requiredKey = replace_start + 1; // skip '$'
-				char* value = getValueByKey(localVars, lengthLocalVars, requiredKey);
-				if (value != NULL) {
-					// key found, so replace by value
-					newArgv[i] = replaceByPointers(newArgv[i], replace_start, value);
-				}
-				else {
-					// key not found, so replace by nothing (empty string) as shell behaviour
-					newArgv[i] = replaceByPointers(newArgv[i], replace_start, "");
-				}
-				free(value);
-			}
+		char** newArgv = lexer.argv;
+		int newArgc = lexer.argc;
+		if (newArgc == 0) {
+			continue; // only blanks, or nothing before a ';'
 		}
 
 		// check for IO and stderr Redirection
 		bool successFlag = true;
 		for (int i = 0; i < newArgc; i++) {
-			if (strcmp(newArgv[i], "<") == 0) {
+			if (lexer.kinds[i] == TOKEN_IN) {
 				int j = i + 1;
-				if (j >= newArgc) {
-					fprintf(stderr, "syntax error near unexpected token `newline'\n");
+				if (j >= newArgc || lexer.kinds[j] != TOKEN_WORD) {
+					fprintf(stderr, "syntax error near unexpected token `%s'\n", j < newArgc ? newArgv[j] : "newline");
 					successFlag = false;
 					last_status = -1;
 					break;
@@ -133,20 +159,18 @@ int microshell_main(int argc, char *argv[]) {
 				// redirect input
 				if (dup2(fd, 0) < 0) {
 					perror("Error in dup2 --> failed to duplicate input fd to point to stdin");
-					free(input_line);
 					exit(DUP_ERROR);
 				}
 
 				if (close(fd) < 0) {
 					perror("Error in closing source file descriptor");
-					free(input_line);
 					exit(CLOSE_ERROR);
 				}
 			}
-			else if (strcmp(newArgv[i], ">") == 0) {
+			else if (lexer.kinds[i] == TOKEN_OUT) {
 				int j = i + 1;
-				if (j >= newArgc) {
-					fprintf(stderr, "syntax error near unexpected token `newline'\n");
+				if (j >= newArgc || lexer.kinds[j] != TOKEN_WORD) {
+					fprintf(stderr, "syntax error near unexpected token `%s'\n", j < newArgc ? newArgv[j] : "newline");
 					successFlag = false;
 					last_status = -1;
 					break;
@@ -162,20 +186,18 @@ int microshell_main(int argc, char *argv[]) {
 				// redirect output
 				if (dup2(fd, 1) < 0) {
 					perror("Error in dup2 --> failed to duplicate input fd to point to stdin");
-					free(input_line);
 					exit(DUP_ERROR);
 				}
 
 				if (close(fd) < 0) {
 					perror("Error in closing source file descriptor");
-					free(input_line);
 					exit(CLOSE_ERROR);
 				}
 			}
-			else if (strcmp(newArgv[i], "2>") == 0) {
+			else if (lexer.kinds[i] == TOKEN_ERR_OUT) {
 				int j = i + 1;
-				if (j >= newArgc) {
-					fprintf(stderr, "syntax error near unexpected token `newline'\n");
+				if (j >= newArgc || lexer.kinds[j] != TOKEN_WORD) {
+					fprintf(stderr, "syntax error near unexpected token `%s'\n", j < newArgc ? newArgv[j] : "newline");
 					successFlag = false;
 					last_status = -1;
 					break;
@@ -191,138 +213,115 @@ int microshell_main(int argc, char *argv[]) {
 				// redirect input
 				if (dup2(fd, 2) < 0) {
 					perror("Error in dup2 --> failed to duplicate input fd to point to stdin");
-					free(input_line);
 					exit(DUP_ERROR);
 				}
 
 				if (close(fd) < 0) {
 					perror("Error in closing source file descriptor");
-					free(input_line);
 					exit(CLOSE_ERROR);
 				}
 			}
 		}
 
 		if (!successFlag) {
-			free(input_line);
-			dup2(saved_stdin, 0);
-			dup2(saved_stdout, 1);
-			dup2(saved_stderr, 2);
+			restore_fds(saved_stdin, saved_stdout, saved_stderr);
 			continue;
 		}
 
-		// delete IO, and stderr redirections from newArgv array
-		for (int i = 0; i < newArgc - 1; i++) {
-			if ((strcmp(newArgv[i], "<") == 0) || (strcmp(newArgv[i], ">") == 0) || (strcmp(newArgv[i], "2>") == 0)) {
-				// Shift all args after i+2 to the left by 2 positions
-				for (int j = i; j < newArgc - 2; ++j) {
-					newArgv[j] = newArgv[j + 2];
-				}
-
-				newArgc -= 2;
-				newArgv[newArgc] = NULL;
-				newArgv[newArgc + 1] = NULL;
-
-				i--; // Re-check this index in case another redirection follows
+		// delete IO, and stderr redirections from newArgv array, the words are moved down in one pass
+		int kept = 0;
+		for (int i = 0; i < newArgc; i++) {
+			if (lexer.kinds[i] != TOKEN_WORD) {
+				i++; // and its file name
+				continue;
 			}
+			newArgv[kept++] = newArgv[i];
 		}
+		newArgc = kept;
+		newArgv[newArgc] = NULL;
 
+		if (newArgc == 0) {
+			// only redirections: the files are opened (and created) and that's all
+			restore_fds(saved_stdin, saved_stdout, saved_stderr);
+			continue;
+		}
 
 		if (strcmp(newArgv[0], "echo") == 0) {
 			int value_returned = echo(newArgc, newArgv);
 			if (value_returned < 0) {
-				free(input_line);
 				exit(value_returned);
 			}
 			last_status = value_returned;
-			free(input_line);
 			// Restore the original descriptors
-			dup2(saved_stdin, 0);
-			dup2(saved_stdout, 1);
-			dup2(saved_stderr, 2);
+			restore_fds(saved_stdin, saved_stdout, saved_stderr);
 			continue;
 		}
 		else if (strcmp(newArgv[0], "pwd") == 0) {
 			int value_returned = pwd(newArgc);
 			if (value_returned < 0) {
-				free(input_line);
 				exit(value_returned);
 			}
 			last_status = value_returned;
-			free(input_line);
 			// Restore the original descriptors
-			dup2(saved_stdin, 0);
-			dup2(saved_stdout, 1);
-			dup2(saved_stderr, 2);
+			restore_fds(saved_stdin, saved_stdout, saved_stderr);
 			continue;
 		}
 		else if (strcmp(newArgv[0], "cd") == 0) {
 			int value_returned = cd(newArgc, newArgv);
 			if (value_returned < 0 && value_returned != CHDIR_ERROR) {
-				free(input_line);
 				exit(value_returned);
 			}
 			last_status = value_returned;
-			free(input_line);
 			// Restore the original descriptors
-			dup2(saved_stdin, 0);
-			dup2(saved_stdout, 1);
-			dup2(saved_stderr, 2);
+			restore_fds(saved_stdin, saved_stdout, saved_stderr);
+			continue;
+		}
+		else if (((strcmp(newArgv[0], "cp") == 0) && fileops_cp_handles(newArgc, newArgv))
+			|| ((strcmp(newArgv[0], "mv") == 0) && fileops_mv_handles(newArgc, newArgv))) {
+			// run in this process through the file operations library, no fork + exec
+			// (an option only the system's cp / mv knows, like cp -p, goes to execvp below)
+			int value_returned = (newArgv[0][0] == 'c') ? fileops_cp(newArgc, newArgv) : fileops_mv(newArgc, newArgv);
+			last_status = value_returned & 0xff; // the exit status the command would have had
+			// Restore the original descriptors (what cp printed with --bench goes to the redirection first)
+			restore_fds(saved_stdin, saved_stdout, saved_stderr);
 			continue;
 		}
 		else if (strcmp(newArgv[0], "exit") == 0) {
-			printf("Good Bye\n");
-			free(input_line);
+			if (show_prompt) {
+				printf("Good Bye\n");
+			}
 			break;
 		}
 		else if ((matchesEqualPattern(newArgv[0])) && (newArgc == 1)) {
 			// Key=Value
-			// save the variable
-			// deep copy
-			char* copy = (char*)malloc(strlen(newArgv[0]) + 1);
-			if (copy == NULL) {
+			// save the variable, a variable that is already there gets the new value in place
+			char* equal = strchr(newArgv[0], '=');
+			if (var_store_set(localVars, newArgv[0], equal - newArgv[0], equal + 1, strlen(equal + 1)) < 0) {
 				perror("Unable to allocate memory");
 				exit(MALLOC_ERROR);
 			}
-			strcpy(copy, newArgv[0]);
 
-			localVars[lengthLocalVars++] = copy;
-
-			if (lengthLocalVars >= sizeLocalVars) {
-				sizeLocalVars *= 2;
-				char** new_localVars = (char**)realloc(localVars, sizeLocalVars * sizeof(char*));
-				if (new_localVars == NULL) {
-					perror("Unable to reallocate memory");
-					free(localVars);
-					exit(REALLOC_ERROR);
-				}
-				localVars = new_localVars;
-			}
-
-			free(input_line);
 			// Restore the original descriptors
-			dup2(saved_stdin, 0);
-			dup2(saved_stdout, 1);
-			dup2(saved_stderr, 2);
+			restore_fds(saved_stdin, saved_stdout, saved_stderr);
 			continue;
 		}
 		else if (strcmp(newArgv[0], "export") == 0) {
-			int value_returned = my_export(newArgc, newArgv, localVars, lengthLocalVars);
+			int value_returned = my_export(newArgc, newArgv, localVars);
 			if (value_returned < 0) {
-				free(input_line);
 				exit(value_returned);
 			}
 			last_status = value_returned;
 
-			free(input_line);
 			// Restore the original descriptors
-			dup2(saved_stdin, 0);
-			dup2(saved_stdout, 1);
-			dup2(saved_stderr, 2);
+			restore_fds(saved_stdin, saved_stdout, saved_stderr);
 			continue;
 		}
 
 
+		// the child gets a copy of the stdio buffers, and if execvp fails its exit writes them
+		// out again, so what the shell printed so far (cd errors...) is written before the fork
+		fflush(stdout);
+		fflush(stderr);
 		pid_t pid = fork();
 
 		if (pid > 0) {
@@ -330,7 +329,6 @@ int microshell_main(int argc, char *argv[]) {
 			int status;
 			if (wait(&status) < 0) {
 				perror("Error in wait");
-				free(input_line);
 				exit(WAIT_ERROR);
 			}
 			if (WIFEXITED(status)) {
@@ -340,10 +338,8 @@ int microshell_main(int argc, char *argv[]) {
 				char* error_msg = "Child didn't exit normally\n";
 				if (write(2, error_msg, strlen(error_msg)) < 0) {
 					perror("Error in writing to standard error file");
-					free(input_line);
 					exit(WRITE_ERROR);
 				}
-				free(input_line);
 				exit(CHILD_ERROR);
 			}
 		}
@@ -352,96 +348,54 @@ int microshell_main(int argc, char *argv[]) {
 			int exec_return = execvp(newArgv[0], newArgv);
 			// if failed
 			printf("%s: command not found\n", newArgv[0]);
-			free(input_line);
 			exit(exec_return);
 		}
 		else {
 			perror("Error in fork");
-			free(input_line);
 			exit(FORK_ERROR);
 		}
 
-		free(input_line);
 
 		// Restore the original descriptors
-		dup2(saved_stdin, 0);
-		dup2(saved_stdout, 1);
-		dup2(saved_stderr, 2);
+		restore_fds(saved_stdin, saved_stdout, saved_stderr);
 	}
 
 	close(saved_stdin);
 	close(saved_stdout);
 	close(saved_stderr);
 
-	for (int i = 0; i < lengthLocalVars; i++) {
-		free(localVars[i]);
-	}
-	free(localVars);
+	var_store_free(localVars);
+	line_reader_free(&input);
+	arena_free(&arena);
 	return last_status; // Return the status of the last command
 }
 
 
-char* read_line() {
-	int size = 64; // initial size
-	char* buffer = (char*)malloc(size);
-	if (buffer == NULL) {
-		perror("Unable to allocate buffer");
-		return NULL;
-	}
-
-	int c;
-	int len = 0;
-	while (1) {
-		c = getchar();
-
-		// handles end of file
-		if (c == EOF) {
-			if (len == 0) {
-				// nothing read before exit
-				free(buffer);
-				return NULL;
-			}
-			else {
-				break;
-			}
-		}
-
-		if (c == '\n') {
-			break;
-		}
-
-		buffer[len++] = c;
-
-		if (len >= size) {
-			// resize
-			size *= 2;
-
-			char* new_buffer = (char*)realloc(buffer, size);
-			if (new_buffer == NULL) {
-				perror("Unable to reallocate buffer");
-				free(buffer);
-				return NULL;
-			}
-
-			buffer = new_buffer;
-		}
-	}
-	buffer[len] = '\0'; // add null character at the end of the string
-	return buffer;
+// put stdin, stdout, stderr back after a command, what a builtin printed but stdio still
+// holds is written first, so it lands in the command's redirection and not after it
+static void restore_fds(int saved_stdin, int saved_stdout, int saved_stderr) {
+	fflush(stdout);
+	fflush(stderr);
+	dup2(saved_stdin, 0);
+	dup2(saved_stdout, 1);
+	dup2(saved_stderr, 2);
 }
 
 
-int echo(int argc, char* argv[]) {
+static int echo(int argc, char* argv[]) {
+	// the line is gathered in out and written once at the end, not twice per argument
+	struct out_buf out;
+	out_init(&out, 1);
 	for (int i = 1; i < argc; i++) {
 		// write to stdout
-		if (write(1, argv[i], strlen(argv[i])) < 0) {
+		if (out_str(&out, argv[i]) < 0) {
 			perror("Error in writing to stdout file");
 			return (WRITE_ERROR);
 		}
 
 		// prints sapce between arguments
 		if (i != argc - 1) {
-			if (write(1, " ", 1) < 0) {
+			if (out_write(&out, " ", 1) < 0) {
 				perror("Error in writing to stdout file");
 				return (WRITE_ERROR);
 			}
@@ -449,7 +403,7 @@ int echo(int argc, char* argv[]) {
 	}
 
 	// prints newline at the end (even if no arguments are passed)
-	if (write(1, "\n", 1) < 0) {
+	if ((out_write(&out, "\n", 1) < 0) || (out_flush(&out) < 0)) {
 		perror("Error in writing to stdout file");
 		return (WRITE_ERROR);
 	}
@@ -458,7 +412,7 @@ int echo(int argc, char* argv[]) {
 }
 
 
-int pwd(int argc) {
+static int pwd(int argc) {
 	if (argc > 1) {
 		char* error_msg = "Error in calling pwd, can't add arguments more than command name, Usage: pwd \n";
 		if (write(2, error_msg, strlen(error_msg)) < 0) {
@@ -480,7 +434,9 @@ int pwd(int argc) {
 		return (GETCWD_ERROR);
 	}
 
-	if ((write(1, cwd, strlen(cwd)) < 0) || (write(1, "\n", 1) < 0)) {
+	struct out_buf out;
+	out_init(&out, 1);
+	if ((out_str(&out, cwd) < 0) || (out_write(&out, "\n", 1) < 0) || (out_flush(&out) < 0)) {
 		perror("Error in writing to standard output file");
 		return (WRITE_ERROR);
 	}
@@ -489,7 +445,7 @@ int pwd(int argc) {
 	return 0;
 }
 
-int cd(int argc, char* argv[]) {
+static int cd(int argc, char* argv[]) {
 	if (argc > 2) {
 		char* error_msg = "cd: too many arguments\n";
 		if (write(2, error_msg, strlen(error_msg)) < 0) {
@@ -521,7 +477,7 @@ int cd(int argc, char* argv[]) {
 }
 
 
-int matchesEqualPattern(char* str) {
+static int matchesEqualPattern(char* str) {
 	char* occurrence_of_equal = strchr(str, '=');
 
 	if (occurrence_of_equal == NULL) {
@@ -538,7 +494,7 @@ int matchesEqualPattern(char* str) {
 }
 
 
-int my_export(int argc, char* argv[], char** localVars, int lengthLocalVars) {
+static int my_export(int argc, char* argv[], struct var_store* localVars) {
 	if (argc == 1) {
 		char* error_msg = "export: No variables passed\n";
 		if (write(2, error_msg, strlen(error_msg)) < 0) {
@@ -549,114 +505,17 @@ int my_export(int argc, char* argv[], char** localVars, int lengthLocalVars) {
 	}
 
 	for (int i = 1; i < argc; i++) {
-		// search for argv[i] in localVars
-		for (int j = 0; j < lengthLocalVars; j++) {
-			///////////////////// get key (variable before equal)
-			int size = 128;
-			char* key = (char*)malloc(size);
-			if (key == NULL) {
-				perror("Unable to allocate memory");
-				return (MALLOC_ERROR);
-			}
-			int len = 0;
-
-			for (int k = 0; localVars[j][k] != '='; k++) {
-				key[len++] = localVars[j][k];
-
-				if (len >= size) {
-					// resize
-					size *= 2;
-
-					char* new_key = (char*)realloc(key, size);
-					if (new_key == NULL) {
-						perror("Unable to reallocate buffer");
-						free(key);
-						return (REALLOC_ERROR);
-					}
-
-					key = new_key;
-				}
-			}
-			////////////////////////////////////////////////////
-
-			if (strcmp(argv[i], key) == 0) {
-				// add to path variables
-				if (putenv(localVars[j]) < 0) {
-					perror("Error in putenv");
-					return (PUTENV_ERROR);
-				}
-			}
+		// add to path variables, a variable that isn't set is ignored
+		if (var_store_export(localVars, argv[i]) < 0) {
+			perror("Error in setenv");
+			return (PUTENV_ERROR);
 		}
 	}
 	return 0;
 }
 
 
-char* getValueByKey(char** localVars, int lengthLocalVars, char* requiredKey) {
-	for (int j = 0; j < lengthLocalVars; j++) {
-		///////////////////// get key (variable before equal)
-		int size = 128;
-		char* key = (char*)malloc(size);
-		if (key == NULL) {
-			perror("Unable to allocate memory");
-			return (NULL);
-		}
-		int len = 0;
-
-		for (int k = 0; localVars[j][k] != '='; k++) {
-			key[len++] = localVars[j][k];
-
-			if (len >= size) {
-				// resize
-				size *= 2;
-
-				char* new_key = (char*)realloc(key, size);
-				if (new_key == NULL) {
-					perror("Unable to reallocate buffer");
-					free(key);
-					return (NULL);
-				}
-
-				key = new_key;
-			}
-		}
-
-		key[len] = '\0';
-		// compare key with required
-		if (strcmp(requiredKey, key) == 0) {
-			char* value = strchr(localVars[j], '=');
-			value++; // as not to take '=' itself
-
-			char* result = (char*)malloc(strlen(value) + 1); // +1 for null terminator
-			if (result == NULL) {
-				perror("Unable to allocate memory");
-				return (NULL);
-			}
-
-			strcpy(result, value);
-			return result; // return value of the variable if found
-		}
-		free(key);
-	}
-	return NULL; // not found
-}
-
-
-char* replaceByPointers(char* pre_str, char* replace_start, char* post_str) {
-	size_t pre_length = replace_start - pre_str;
-	size_t post_length = strlen(post_str);
-
-	char* result = (char*)malloc(pre_length + post_length + 1); // +1 for null terminator
-	if (result == NULL) {
-		perror("Unable to allocate memory");
-		return (NULL);
-	}
-
-	// copy the prefix of pre_str
-	strncpy(result, pre_str, pre_length);
-
-	// copy the suffix from post_str
-	strcpy(result + pre_length, post_str);
-
-	return result;
+// $NAME for the lexer: the value of a local variable
+static const char* lookup_var(void* localVars, const char* name, size_t name_len, size_t* value_len) {
+	return var_store_get((struct var_store*)localVars, name, name_len, value_len);
 }
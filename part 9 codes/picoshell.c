@@ -1,10 +1,16 @@
 #include <stdlib.h>	// to use malloc, realloc, exit, getenv
-#include <stdio.h>	// to use getchar, EOF, perror, fflush
-#include <string.h>	// to use strlen, strtok, strcmp
+#include <stdio.h>	// to use perror, fflush
+#include <string.h>	// to use strlen, strcmp
 #include <unistd.h>     // to use write, getcwd, fork, execvp, chdir, isatty
 #include <sys/types.h>	// to use pid_t
 #include <sys/wait.h>	// to use wait
 
+#include "fileops.h"	// to use fileops_cp, fileops_mv, fileops_cp_handles, fileops_mv_handles (Assignment part 8)
+#include "outbuf.h"	// to use out_init, out_write, out_str, out_flush (Assignment part 8)
+#include "line_reader.h"	// to use line_reader_init, line_reader_next, line_reader_free
+#include "arena.h"	// to use arena_init, arena_reset, arena_free, struct arena
+#include "lexer.h"	// to use lexer_init, lexer_split, struct lexer
+
 
 #define READ_ERROR 	-1
 #define WRITE_ERROR 	-2
@@ -16,15 +22,13 @@
 #define EXEC_ERROR	-8
 #define CHDIR_ERROR	-9
 #define GETENV_ERROR	-10
+#define MALLOC_ERROR	-11
 
 
-#define MAX_ARGS 150
-
 
-char* read_line();
-int echo(int argc, char* argv[]);
-int pwd(int argc);
-int cd(int argc, char* argv[]);
+static int echo(int argc, char* argv[]);
+static int pwd(int argc);
+static int cd(int argc, char* argv[]);
 
 
 int picoshell_main(int argc, char *argv[]) {
@@ -32,79 +36,131 @@ int picoshell_main(int argc, char *argv[]) {
 
 	int last_status = 0; // Track the last command status
 
+	// the commands come from stdin, a script file or -c, read in big blocks either way
+	struct line_reader input;
+	int show_prompt = line_reader_from_args(&input, argc, argv);
+	if (show_prompt < 0) {
+		exit(ARGUMENT_ERROR);
+	}
+	// the prompt and the newline after a line that isn't echoed by a terminal are
+	// only for stdin, and the terminal is checked once, not before every line
+	int echo_newline = show_prompt && !isatty(STDIN_FILENO);
+
+	// what is left of the line after a ';', the next command starts there
+	const char* pending = NULL;
+	size_t pending_len = 0;
+
+	// everything a command allocates (its words, the expanded ones) comes from the arena,
+	// which is reset before the next command instead of freeing every piece of it
+	struct arena arena;
+	arena_init(&arena);
+	struct lexer lexer;
+	lexer_init(&lexer, &arena, NULL, NULL); // no variables, a '$' is kept
+
 	while (1) {
-		int is_interactive = isatty(STDIN_FILENO);
+		if (pending_len == 0) {
+			if (show_prompt) {
+				printf("Pico shell prompt > ");
+				fflush(stdout);
+			}
 
-		printf("Pico shell prompt > ");
-		fflush(stdout);
+			size_t input_len;
+			char* input_line = line_reader_next(&input, &input_len); // a view into input, no free
+			if (input_line == NULL) {
+				if (show_prompt) {
+					printf("\n"); // mimic shell behavior on EOF
+				}
+				break;
+			}
 
-		char* input_line = read_line();
-		if (input_line == NULL) {
-			printf("\n"); // mimic shell behavior on EOF
-			break;
-		}
+			if (input_len == 0) {
+				if (echo_newline) {
+					printf("\n");
+				}
+				continue;
+			}
 
-		if (strlen(input_line) == 0) {
-			if (!is_interactive) {
+			if (echo_newline) {
 				printf("\n");
+				fflush(stdout);
 			}
-			free(input_line);
-			continue;
+
+			pending = input_line;
+			pending_len = input_len;
 		}
 
-		if (!is_interactive) {
-			printf("\n");
+		// the prompt's fflush was what wrote a command's printf output before the next one ran,
+		// a script or -c has no prompt so stdout is flushed here once per command
+		if (!show_prompt) {
 			fflush(stdout);
 		}
 
-		char* newArgv[MAX_ARGS];
-		int newArgc = 0;
-
-		char* token = strtok(input_line, " ");
-		while (token != NULL && newArgc < MAX_ARGS) {
-			newArgv[newArgc++] = token;
-			token = strtok(NULL, " ");
+		arena_reset(&arena);
+		size_t used = pending_len; // after an error the rest of the line is dropped
+		int lex_status = lexer_split(&lexer, pending, pending_len, 0, &used);
+		pending += used;
+		pending_len -= used;
+		if (lex_status == LEX_MALLOC_ERROR) {
+			exit(MALLOC_ERROR);
+		}
+		if (lex_status < 0) {
+			last_status = -1;
+			continue;
 		}
 
-		newArgv[newArgc] = NULL;
+		char** newArgv = lexer.argv;
+		int newArgc = lexer.argc;
+		if (newArgc == 0) {
+			continue; // only blanks, or nothing before a ';'
+		}
 
 		if (strcmp(newArgv[0], "echo") == 0) {
 			int value_returned = echo(newArgc, newArgv);
 			if (value_returned < 0) {
-				free(input_line);
 				exit(value_returned);
 			}
 			last_status = value_returned;
-			free(input_line);
 			continue;
 		}
 		else if (strcmp(newArgv[0], "pwd") == 0) {
 			int value_returned = pwd(newArgc);
 			if (value_returned < 0) {
-				free(input_line);
 				exit(value_returned);
 			}
 			last_status = value_returned;
-			free(input_line);
 			continue;
 		}
 		else if (strcmp(newArgv[0], "cd") == 0) {
 			int value_returned = cd(newArgc, newArgv);
 			if (value_returned < 0 && value_returned != CHDIR_ERROR) {
-				free(input_line);
 				exit(value_returned);
 			}
 			last_status = value_returned;
-			free(input_line);
+			continue;
+		}
+		else if (((strcmp(newArgv[0], "cp") == 0) && fileops_cp_handles(newArgc, newArgv))
+			|| ((strcmp(newArgv[0], "mv") == 0) && fileops_mv_handles(newArgc, newArgv))) {
+			// run in this process through the file operations library, no fork + exec
+			// (an option only the system's cp / mv knows, like cp -p, goes to execvp below)
+			int value_returned = (newArgv[0][0] == 'c') ? fileops_cp(newArgc, newArgv) : fileops_mv(newArgc, newArgv);
+			last_status = value_returned & 0xff; // the exit status the command would have had
+			// what cp printed (--bench, -v) goes out before anything else writes to the same files
+			fflush(stdout);
+			fflush(stderr);
 			continue;
 		}
 		else if (strcmp(newArgv[0], "exit") == 0) {
-			printf("Good Bye\n");
-			free(input_line);
+			if (show_prompt) {
+				printf("Good Bye\n");
+			}
 			break;
 		}
 
 
+		// the child gets a copy of the stdio buffers, and if execvp fails its exit writes them
+		// out again, so what the shell printed so far (cd errors...) is written before the fork
+		fflush(stdout);
+		fflush(stderr);
 		pid_t pid = fork();
 
 		if (pid > 0) {
@@ -112,7 +168,6 @@ int picoshell_main(int argc, char *argv[]) {
 			int status;
 			if (wait(&status) < 0) {
 				perror("Error in wait");
-				free(input_line);
 				exit(WAIT_ERROR);
 			}
 			if (WIFEXITED(status)) {
@@ -122,10 +177,8 @@ int picoshell_main(int argc, char *argv[]) {
 				char* error_msg = "Child didn't exit normally\n";
 				if (write(2, error_msg, strlen(error_msg)) < 0) {
 					perror("Error in writing to standard error file");
-					free(input_line);
 					exit(WRITE_ERROR);
 				}
-				free(input_line);
 				exit(CHILD_ERROR);
 			}
 		}
@@ -134,83 +187,35 @@ int picoshell_main(int argc, char *argv[]) {
 			int exec_return = execvp(newArgv[0], newArgv);
 			// if failed
 			printf("%s: command not found\n", newArgv[0]);
-			free(input_line);
 			exit(exec_return);
 		}
 		else {
 			perror("Error in fork");
-			free(input_line);
 			exit(FORK_ERROR);
 		}
 
-		free(input_line);
 	}
 
+	line_reader_free(&input);
+	arena_free(&arena);
 	return last_status; // Return the status of the last command
 }
 
 
-char* read_line() {
-	int size = 64; // initial size
-	char* buffer = (char*)malloc(size);
-	if (buffer == NULL) {
-		perror("Unable to allocate buffer");
-		return NULL;
-	}
-
-	int c;
-	int len = 0;
-	while (1) {
-		c = getchar();
-
-		// handles end of file
-		if (c == EOF) {
-			if (len == 0) {
-				// nothing read before exit
-				free(buffer);
-				return NULL;
-			}
-			else {
-				break;
-			}
-		}
-
-		if (c == '\n') {
-			break;
-		}
-
-		buffer[len++] = c;
-
-		if (len >= size) {
-			// resize
-			size *= 2;
-
-			char* new_buffer = (char*)realloc(buffer, size);
-			if (new_buffer == NULL) {
-				perror("Unable to reallocate buffer");
-				free(buffer);
-				return NULL;
-			}
-
-			buffer = new_buffer;
-		}
-	}
-	buffer[len] = '\0'; // add null character at the end of the string
-	return buffer;
-}
-
-
-int echo(int argc, char* argv[]) {
+static int echo(int argc, char* argv[]) {
+	// the line is gathered in out and written once at the end, not twice per argument
+	struct out_buf out;
+	out_init(&out, 1);
 	for (int i = 1; i < argc; i++) {
 		// write to stdout
-		if (write(1, argv[i], strlen(argv[i])) < 0) {
+		if (out_str(&out, argv[i]) < 0) {
 			perror("Error in writing to stdout file");
 			return (WRITE_ERROR);
 		}
 
 		// prints sapce between arguments
 		if (i != argc - 1) {
-			if (write(1, " ", 1) < 0) {
+			if (out_write(&out, " ", 1) < 0) {
 				perror("Error in writing to stdout file");
 				return (WRITE_ERROR);
 			}
@@ -218,7 +223,7 @@ int echo(int argc, char* argv[]) {
 	}
 
 	// prints newline at the end (even if no arguments are passed)
-	if (write(1, "\n", 1) < 0) {
+	if ((out_write(&out, "\n", 1) < 0) || (out_flush(&out) < 0)) {
 		perror("Error in writing to stdout file");
 		return (WRITE_ERROR);
 	}
@@ -227,7 +232,7 @@ int echo(int argc, char* argv[]) {
 }
 
 
-int pwd(int argc) {
+static int pwd(int argc) {
 	if (argc > 1) {
 		char* error_msg = "Error in calling pwd, can't add arguments more than command name, Usage: pwd \n";
 		if (write(2, error_msg, strlen(error_msg)) < 0) {
@@ -249,7 +254,9 @@ int pwd(int argc) {
 		return (GETCWD_ERROR);
 	}
 
-	if ((write(1, cwd, strlen(cwd)) < 0) || (write(1, "\n", 1) < 0)) {
+	struct out_buf out;
+	out_init(&out, 1);
+	if ((out_str(&out, cwd) < 0) || (out_write(&out, "\n", 1) < 0) || (out_flush(&out) < 0)) {
 		perror("Error in writing to standard output file");
 		return (WRITE_ERROR);
 	}
@@ -258,7 +265,7 @@ int pwd(int argc) {
 	return 0;
 }
 
-int cd(int argc, char* argv[]) {
+static int cd(int argc, char* argv[]) {
 	if (argc > 2) {
 		char* error_msg = "cd: too many arguments\n";
 		if (write(2, error_msg, strlen(error_msg)) < 0) {
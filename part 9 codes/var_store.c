@@ -0,0 +1,143 @@
+#define _POSIX_C_SOURCE 200809L	// to use setenv
+#include <stdlib.h>	// to use malloc, calloc, realloc, free, setenv
+#include <string.h>	// to use memcmp, memcpy, strlen
+
+#include "var_store.h"
+
+#define VAR_STORE_MIN 64	// initial number of slots, always a power of 2
+
+
+struct var_entry {
+	char* text;		// "KEY\0VALUE\0", NULL for a free slot
+	size_t key_len;
+	size_t value_len;
+	size_t size;		// allocated bytes of text
+	unsigned int hash;
+	int exported;
+};
+
+struct var_store {
+	struct var_entry* slots;
+	size_t size;		// number of slots
+	size_t count;
+};
+
+
+// FNV-1a, the keys are short names
+static unsigned int hash_key(const char* key, size_t key_len) {
+	unsigned int hash = 2166136261u;
+	for (size_t i = 0; i < key_len; i++) {
+		hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+	}
+	return hash;
+}
+
+// the slot of key, or the free slot where it would go
+static struct var_entry* find_slot(const struct var_store* store, const char* key, size_t key_len, unsigned int hash) {
+	size_t slot = hash & (store->size - 1);
+	while (store->slots[slot].text != NULL) {
+		struct var_entry* entry = &store->slots[slot];
+		if (entry->hash == hash && entry->key_len == key_len && memcmp(entry->text, key, key_len) == 0) {
+			return entry;
+		}
+		slot = (slot + 1) & (store->size - 1);
+	}
+	return &store->slots[slot];
+}
+
+// double the slots when 3/4 are used, so the probes stay short
+static int grow(struct var_store* store) {
+	struct var_entry* old_slots = store->slots;
+	size_t old_size = store->size;
+	store->slots = calloc(old_size * 2, sizeof(struct var_entry));
+	if (store->slots == NULL) {
+		store->slots = old_slots;
+		return -1;
+	}
+	store->size = old_size * 2;
+	for (size_t i = 0; i < old_size; i++) {
+		if (old_slots[i].text != NULL) {
+			*find_slot(store, old_slots[i].text, old_slots[i].key_len, old_slots[i].hash) = old_slots[i];
+		}
+	}
+	free(old_slots);
+	return 0;
+}
+
+
+struct var_store* var_store_new(void) {
+	struct var_store* store = calloc(1, sizeof(struct var_store));
+	if (store == NULL) {
+		return NULL;
+	}
+	store->slots = calloc(VAR_STORE_MIN, sizeof(struct var_entry));
+	if (store->slots == NULL) {
+		free(store);
+		return NULL;
+	}
+	store->size = VAR_STORE_MIN;
+	return store;
+}
+
+void var_store_free(struct var_store* store) {
+	if (store != NULL) {
+		for (size_t i = 0; i < store->size; i++) {
+			free(store->slots[i].text);
+		}
+		free(store->slots);
+		free(store);
+	}
+}
+
+const char* var_store_get(const struct var_store* store, const char* key, size_t key_len, size_t* value_len) {
+	struct var_entry* entry = find_slot(store, key, key_len, hash_key(key, key_len));
+	if (entry->text == NULL) {
+		return NULL;
+	}
+	*value_len = entry->value_len;
+	return entry->text + entry->key_len + 1;
+}
+
+int var_store_set(struct var_store* store, const char* key, size_t key_len, const char* value, size_t value_len) {
+	if ((store->count + 1) * 4 > store->size * 3 && grow(store) < 0) {
+		return -1;
+	}
+	unsigned int hash = hash_key(key, key_len);
+	struct var_entry* entry = find_slot(store, key, key_len, hash);
+	size_t needed = key_len + value_len + 2;
+	if (entry->size < needed) {
+		char* text = realloc(entry->text, needed);
+		if (text == NULL) {
+			return -1;
+		}
+		if (entry->text == NULL) {
+			// a new variable
+			memcpy(text, key, key_len);
+			text[key_len] = '\0';
+			entry->key_len = key_len;
+			entry->hash = hash;
+			entry->exported = 0;
+			store->count++;
+		}
+		entry->text = text;
+		entry->size = needed;
+	}
+	char* stored_value = entry->text + key_len + 1;
+	memcpy(stored_value, value, value_len);
+	stored_value[value_len] = '\0';
+	entry->value_len = value_len;
+	if (entry->exported && setenv(entry->text, stored_value, 1) < 0) {
+		return -1;
+	}
+	return 0;
+}
+
+int var_store_export(struct var_store* store, const char* key) {
+	size_t key_len = strlen(key);
+	struct var_entry* entry = find_slot(store, key, key_len, hash_key(key, key_len));
+	if (entry->text == NULL) {
+		return 0;
+	}
+	entry->exported = 1;
+	return setenv(entry->text, entry->text + key_len + 1, 1);
+}
@@ -0,0 +1,27 @@
+#ifndef VAR_STORE_H
+#define VAR_STORE_H
+
+#include <stddef.h>	// to use size_t
+
+// the local variables of a shell: key -> value, open addressing with linear probing
+// every variable is one allocation "KEY\0VALUE\0" in which the key is kept once (interned)
+// and the value is overwritten in place, so assigning a variable again in a loop doesn't
+// add anything, the allocation only grows when a value is longer than every one before
+struct var_store;
+
+struct var_store* var_store_new(void);
+void var_store_free(struct var_store* store);
+
+// the value of key[0..key_len) and its length, NULL when it isn't set,
+// only valid until the next var_store_set
+const char* var_store_get(const struct var_store* store, const char* key, size_t key_len, size_t* value_len);
+
+// set key[0..key_len) to value[0..value_len), also in the environment once it is exported,
+// 0 or -1 when the memory ran out
+int var_store_set(struct var_store* store, const char* key, size_t key_len, const char* value, size_t value_len);
+
+// put key in the environment, now and after every later var_store_set,
+// 0 (also when key isn't set, there is nothing to export) or -1 when setenv fails
+int var_store_export(struct var_store* store, const char* key);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>	// to use fprintf
+
+#define SKIP_TEST 77	// exit code ctest reports as skipped (SKIP_RETURN_CODE)
+
+// the failed checks of the test, main returns check_failures != 0
+static int check_failures;
+
+// report a failed condition with where it is and go on with the next check
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			check_failures++; \
+		} \
+	} while (0)
+
+#endif
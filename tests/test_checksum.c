@@ -0,0 +1,85 @@
+#include <stdlib.h>	// to use malloc, calloc, free, rand, srand
+#include <string.h>	// to use strlen
+
+#include "check.h"	// to use CHECK
+
+// the module itself, for its static table and SSE4.2 kernels
+#include "copy_checksum.c"
+
+#define BIG (1024 * 1024 + 13)
+
+// one bit at a time, straight from the definition
+static uint32_t crc32c_bitwise(uint32_t crc, const unsigned char* p, size_t len) {
+	crc = ~crc;
+	while (len-- > 0) {
+		crc ^= *p++;
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+		}
+	}
+	return ~crc;
+}
+
+// a kernel works on the inverted crc like crc32c does with it
+static uint32_t with_kernel(uint32_t (*kernel)(uint32_t, const unsigned char*, size_t), uint32_t crc, const unsigned char* p, size_t len) {
+	return ~kernel(~crc, p, len);
+}
+
+// every start alignment and every length around the 8 and 32 byte steps, and a big buffer
+static void check_kernel(const char* name, uint32_t (*kernel)(uint32_t, const unsigned char*, size_t), const unsigned char* data) {
+	int wrong = 0;
+	for (size_t start = 0; start < 16; start++) {
+		for (size_t len = 0; len < 300; len++) {
+			wrong += with_kernel(kernel, 0, data + start, len) != crc32c_bitwise(0, data + start, len);
+		}
+	}
+	wrong += with_kernel(kernel, 0x12345678, data + 3, BIG - 3) != crc32c_bitwise(0x12345678, data + 3, BIG - 3);
+	if (wrong != 0) {
+		fprintf(stderr, "  %s: %d wrong checksums\n", name, wrong);
+		check_failures++;
+	}
+}
+
+int main(void) {
+	pthread_once(&init_once, crc32c_init);
+
+	// the check value of CRC-32C
+	const char* digits = "123456789";
+	CHECK(crc32c(0, digits, strlen(digits)) == 0xE3069283);
+	CHECK(crc32c_bitwise(0, (const unsigned char*)digits, strlen(digits)) == 0xE3069283);
+	CHECK(crc32c(0, digits, 0) == 0);
+
+	unsigned char* data = malloc(BIG);
+	srand(1);
+	for (size_t i = 0; i < BIG; i++) {
+		data[i] = rand();
+	}
+	// the table is the fallback of every CPU without SSE4.2, it is tested on all of them
+	check_kernel("table", crc32c_table, data);
+#if defined(__x86_64__)
+	if (__builtin_cpu_supports("sse4.2")) {
+		check_kernel("sse4.2", crc32c_sse42, data);
+	}
+	else {
+		fprintf(stderr, "  no SSE4.2 on this CPU, only the table was tested\n");
+	}
+#endif
+
+	// hashed in parts it is the same as in one go
+	unsigned int whole = crc32c(0, data, BIG);
+	unsigned int parts = 0;
+	for (size_t pos = 0; pos < BIG; pos += 4099) {
+		parts = crc32c(parts, data + pos, BIG - pos < 4099 ? BIG - pos : 4099);
+	}
+	CHECK(parts == whole);
+
+	// the holes of a sparse copy, shorter and longer than the zero block it uses
+	unsigned char* zeros = calloc(3 * ZERO_BLOCK + 5, 1);
+	off_t lengths[] = {0, 1, 63, ZERO_BLOCK - 1, ZERO_BLOCK, ZERO_BLOCK + 1, 3 * ZERO_BLOCK + 5};
+	for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+		CHECK(crc32c_zeros(0x9abc, lengths[i]) == crc32c(0x9abc, zeros, lengths[i]));
+	}
+	free(zeros);
+	free(data);
+	return check_failures != 0;
+}
@@ -0,0 +1,159 @@
+#define _GNU_SOURCE	// to use FICLONE through linux/fs.h with the other headers
+#include <stdlib.h>	// to use getenv, malloc, free, rand, srand
+#include <string.h>	// to use strtok, strdup, memcmp, memset
+#include <unistd.h>	// to use write, pread, close, unlink, lseek, access
+#include <fcntl.h>	// to use open
+#include <sys/ioctl.h>	// to use ioctl
+#include <sys/stat.h>	// to use stat, fstat
+#include <linux/fs.h>	// to use FICLONE
+
+#include "check.h"		// to use CHECK, SKIP_TEST
+#include "copy_engine.h"	// to use copy_fd, struct copy_options, struct copy_stats
+
+#define DATA_SIZE (1024 * 1024 + 4096)	// whole blocks and a part of one
+#define MAX_DIRS  16
+
+static unsigned char* data;
+
+static int create(const char* path, const void* buf, size_t len) {
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd >= 0 && len > 0 && write(fd, buf, len) != (ssize_t)len) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// what the kernel says about a clone in dir, without the copy engine
+static int clone_works(const char* src, const char* dest) {
+	int fd_src = open(src, O_RDONLY | O_CLOEXEC);
+	int fd_dest = create(dest, NULL, 0);
+	int works = fd_src >= 0 && fd_dest >= 0 && ioctl(fd_dest, FICLONE, fd_src) == 0;
+	close(fd_src);
+	close(fd_dest);
+	unlink(dest);
+	return works;
+}
+
+// the destination holds data[from..DATA_SIZE) at from (or nothing before it was written)
+static int dest_matches(int fd, off_t from) {
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size != DATA_SIZE) {
+		return 0;
+	}
+	unsigned char* buf = malloc(DATA_SIZE);
+	int same = pread(fd, buf, DATA_SIZE - from, from) == DATA_SIZE - from && memcmp(buf, data + from, DATA_SIZE - from) == 0;
+	free(buf);
+	return same;
+}
+
+// copy src to dest with --reflink=mode from offset from of both files
+static int copy_with(const char* src, const char* dest, enum copy_reflink mode, off_t from, struct copy_stats* stats) {
+	int fd_src = open(src, O_RDONLY | O_CLOEXEC);
+	int fd_dest = from > 0 ? open(dest, O_RDWR | O_CLOEXEC) : create(dest, NULL, 0);
+	struct copy_options opts = {0};
+	opts.reflink = mode;
+	memset(stats, 0, sizeof(*stats));
+	int ret = -1;
+	if (fd_src >= 0 && fd_dest >= 0 && lseek(fd_src, from, SEEK_SET) == from && lseek(fd_dest, from, SEEK_SET) == from) {
+		ret = copy_fd(fd_src, fd_dest, &opts, stats);
+		if (ret == 0 && !dest_matches(fd_dest, from)) {
+			ret = 1;
+		}
+	}
+	close(fd_src);
+	close(fd_dest);
+	return ret;
+}
+
+// the choice between clone and copy in one directory, against what the kernel allows there
+static void test_dir(const char* dir) {
+	char src[4096];
+	char dest[4096];
+	snprintf(src, sizeof(src), "%s/spl_clone_src_%d", dir, (int)getpid());
+	snprintf(dest, sizeof(dest), "%s/spl_clone_dest_%d", dir, (int)getpid());
+	int fd = create(src, data, DATA_SIZE);
+	if (fd < 0) {
+		fprintf(stderr, "  %s: not writable, skipped\n", dir);
+		unlink(src);
+		return;
+	}
+	close(fd);
+	int works = clone_works(src, dest);
+	fprintf(stderr, "  %s: %s\n", dir, works ? "clones" : "no clones, copies");
+
+	struct copy_stats stats;
+	// auto: the clone when the file system has them, a copy with the same bytes otherwise
+	CHECK(copy_with(src, dest, REFLINK_AUTO, 0, &stats) == 0);
+	CHECK((stats.strategy == COPY_CLONE) == works);
+	CHECK(stats.bytes == DATA_SIZE);
+
+	// always: the clone or an error, never a copy of the data
+	int ret = copy_with(src, dest, REFLINK_ALWAYS, 0, &stats);
+	if (works) {
+		CHECK(ret == 0 && stats.strategy == COPY_CLONE);
+	}
+	else {
+		CHECK(ret == CLONE_ERROR);
+		struct stat st;
+		CHECK(stat(dest, &st) == 0 && st.st_size == 0);
+	}
+
+	// never: the data is copied without even trying the clone
+	CHECK(copy_with(src, dest, REFLINK_NEVER, 0, &stats) == 0);
+	CHECK(stats.strategy != COPY_CLONE);
+	CHECK(stats.calls_by_kind[CALL_CLONE] == 0);
+
+	// from an offset the clone is a range of the files (FICLONERANGE), the rest of
+	// the destination written by the copy before stays as it is
+	CHECK(copy_with(src, dest, REFLINK_AUTO, 4096, &stats) == 0);
+	CHECK((stats.strategy == COPY_CLONE) == works);
+	CHECK(stats.bytes == DATA_SIZE - 4096);
+
+	unlink(src);
+	unlink(dest);
+}
+
+int main(void) {
+	data = malloc(DATA_SIZE);
+	srand(1);
+	for (size_t i = 0; i < DATA_SIZE; i++) {
+		data[i] = rand();
+	}
+
+	// the build directory and the usual temporary ones, each file system once, and the
+	// directories listed in SPL_TEST_DIRS (separated by ':') to test a btrfs or XFS mount
+	char* dirs[MAX_DIRS];
+	int count = 0;
+	char* candidates[] = {".", "/tmp", "/var/tmp", "/dev/shm"};
+	for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+		dirs[count++] = candidates[i];
+	}
+	char* extra = getenv("SPL_TEST_DIRS") != NULL ? strdup(getenv("SPL_TEST_DIRS")) : NULL;
+	for (char* dir = extra != NULL ? strtok(extra, ":") : NULL; dir != NULL && count < MAX_DIRS; dir = strtok(NULL, ":")) {
+		dirs[count++] = dir;
+	}
+
+	dev_t seen[MAX_DIRS];
+	int tested = 0;
+	for (int i = 0; i < count; i++) {
+		struct stat st;
+		if (stat(dirs[i], &st) < 0 || !S_ISDIR(st.st_mode) || access(dirs[i], W_OK) < 0) {
+			continue;
+		}
+		int known = 0;
+		for (int k = 0; k < tested; k++) {
+			known |= seen[k] == st.st_dev;
+		}
+		if (!known) {
+			seen[tested++] = st.st_dev;
+			test_dir(dirs[i]);
+		}
+	}
+	free(extra);
+	free(data);
+	if (tested == 0) {
+		return SKIP_TEST;
+	}
+	return check_failures != 0;
+}
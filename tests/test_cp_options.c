@@ -0,0 +1,55 @@
+#include <limits.h>	// to use LLONG_MAX
+
+#include "check.h"	// to use CHECK
+
+// cp itself, for its static parse_size
+#include "cp.c"
+
+static void test_parse_size(void) {
+	CHECK(parse_size("1") == 1);
+	CHECK(parse_size("4096") == 4096);
+	CHECK(parse_size("64K") == 64 << 10);
+	CHECK(parse_size("64k") == 64 << 10);
+	CHECK(parse_size("3M") == 3 << 20);
+	CHECK(parse_size("2G") == 2LL << 30);
+
+	// not a size
+	CHECK(parse_size("") == -1);
+	CHECK(parse_size("0") == -1);
+	CHECK(parse_size("-5") == -1);
+	CHECK(parse_size("K") == -1);
+	CHECK(parse_size("12T") == -1);
+	CHECK(parse_size("12KB") == -1);
+	CHECK(parse_size("1 ") == -1);
+
+	// the largest sizes that still fit and the first ones that don't
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%lldG", LLONG_MAX >> 30);
+	CHECK(parse_size(buf) == (LLONG_MAX >> 30) << 30);
+	snprintf(buf, sizeof(buf), "%lldG", (LLONG_MAX >> 30) + 1);
+	CHECK(parse_size(buf) == -1);
+	snprintf(buf, sizeof(buf), "%lldK", (LLONG_MAX >> 10) + 1);
+	CHECK(parse_size(buf) == -1);
+	CHECK(parse_size("9999999999G") == -1);
+	CHECK(parse_size("99999999999999999999") == LLONG_MAX);	// strtoll stops at the largest
+}
+
+// the shells run cp in process only when it knows every option, the rest goes to the system cp
+static void test_handles(void) {
+	char* known[] = {"cp", "-r", "--sparse=never", "--chunk-size=1M", "--", "-p", "b", NULL};
+	CHECK(fileops_cp_handles(7, known));
+	char* unknown[] = {"cp", "-p", "a", "b", NULL};
+	CHECK(!fileops_cp_handles(4, unknown));
+	char* prefix[] = {"cp", "--sparse", "a", "b", NULL};
+	CHECK(!fileops_cp_handles(4, prefix));
+	char* mv_known[] = {"mv", "--sync=batch", "--engine=uring", "a", "b", NULL};
+	CHECK(fileops_mv_handles(5, mv_known));
+	char* mv_unknown[] = {"mv", "-f", "a", "b", NULL};
+	CHECK(!fileops_mv_handles(4, mv_unknown));
+}
+
+int main(void) {
+	test_parse_size();
+	test_handles();
+	return check_failures != 0;
+}
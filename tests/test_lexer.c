@@ -0,0 +1,176 @@
+#include <string.h>	// to use strcmp, strlen, memset
+
+#include "check.h"	// to use CHECK
+#include "lexer.h"	// to use lexer_init, lexer_split, struct lexer, TOKEN_*
+#include "arena.h"	// to use arena_init, arena_reset, arena_free
+
+#define ALL_OPERATORS (TOKEN_MASK(TOKEN_IN) | TOKEN_MASK(TOKEN_OUT) | TOKEN_MASK(TOKEN_ERR_OUT) \
+	| TOKEN_MASK(TOKEN_PIPE) | TOKEN_MASK(TOKEN_AMP))
+
+static char long_value[20000];
+
+// x=5, empty= (set but empty), long=20000 'v', nothing else is set
+static const char* lookup(void* ctx, const char* name, size_t name_len, size_t* value_len) {
+	(void)ctx;
+	if (name_len == 1 && name[0] == 'x') {
+		*value_len = 1;
+		return "5";
+	}
+	if (name_len == 5 && strncmp(name, "empty", 5) == 0) {
+		*value_len = 0;
+		return "";
+	}
+	if (name_len == 4 && strncmp(name, "long", 4) == 0) {
+		*value_len = sizeof(long_value);
+		return long_value;
+	}
+	return NULL;
+}
+
+static struct arena arena;
+static struct lexer lexer;
+
+// split line (its first command) and compare the words with the NULL terminated expected
+static void check_split(const char* line, const char* const* expected) {
+	arena_reset(&arena);
+	size_t used;
+	int ret = lexer_split(&lexer, line, strlen(line), ALL_OPERATORS, &used);
+	CHECK(ret == 0);
+	if (ret != 0) {
+		fprintf(stderr, "  line: %s\n", line);
+		return;
+	}
+	int count = 0;
+	while (expected[count] != NULL) {
+		count++;
+	}
+	CHECK(lexer.argc == count);
+	CHECK(lexer.argv[lexer.argc] == NULL);
+	for (int i = 0; i < count && i < lexer.argc; i++) {
+		if (strcmp(lexer.argv[i], expected[i]) != 0) {
+			fprintf(stderr, "  line: %s, word %d: '%s' instead of '%s'\n", line, i, lexer.argv[i], expected[i]);
+			check_failures++;
+		}
+	}
+}
+
+static void test_words(void) {
+	check_split("", (const char* []){NULL});
+	check_split(" \t ", (const char* []){NULL});
+	check_split("echo  a\tb ", (const char* []){"echo", "a", "b", NULL});
+	check_split("'a b' \"c d\" e\\ f", (const char* []){"a b", "c d", "e f", NULL});
+	check_split("a'b'\"c\"d", (const char* []){"abcd", NULL});
+	check_split("\"a\\\"b\\\\c\\$d\\e\"", (const char* []){"a\"b\\c$d\\e", NULL});
+	check_split("'a\\b' '' \"\"", (const char* []){"a\\b", "", "", NULL});
+	check_split("\\'a", (const char* []){"'a", NULL});
+}
+
+static void test_expansion(void) {
+	// only unquoted and "..." expand, '...' and \$ keep the '$'
+	check_split("echo \"\\$x\" \\$x '$x' $x \"$x\"", (const char* []){"echo", "$x", "$x", "$x", "5", "5", NULL});
+	check_split("a$x.b ${x} $x$x", (const char* []){"a5.b", "${x}", "55", NULL});
+	// a '$' that doesn't start a name stays
+	check_split("$ a$ $1 \"$\"", (const char* []){"$", "a$", "$1", "$", NULL});
+	// an unset or empty variable alone is no word at all, quoted it is an empty one
+	check_split("a $nope b $empty c", (const char* []){"a", "b", "c", NULL});
+	check_split("\"$nope\" '' x$nope", (const char* []){"", "", "x", NULL});
+	// the expansion is not split again and its operators are plain text
+	check_split("$x'>'", (const char* []){"5>", NULL});
+
+	// longer than the line: the words move to a bigger buffer and keep what came before
+	arena_reset(&arena);
+	const char* line = "pre a$long$long \"$long\" post";
+	size_t used;
+	CHECK(lexer_split(&lexer, line, strlen(line), ALL_OPERATORS, &used) == 0);
+	CHECK(lexer.argc == 4);
+	if (lexer.argc == 4) {
+		CHECK(strcmp(lexer.argv[0], "pre") == 0);
+		CHECK(strlen(lexer.argv[1]) == 1 + 2 * sizeof(long_value));
+		CHECK(lexer.argv[1][0] == 'a' && lexer.argv[1][1] == 'v');
+		CHECK(strlen(lexer.argv[2]) == sizeof(long_value));
+		CHECK(strcmp(lexer.argv[3], "post") == 0);
+	}
+
+	// without a lookup (picoshell) every '$' is kept
+	struct lexer plain;
+	lexer_init(&plain, &arena, NULL, NULL);
+	arena_reset(&arena);
+	line = "$x \"$x\"";
+	CHECK(lexer_split(&plain, line, strlen(line), ALL_OPERATORS, &used) == 0);
+	CHECK(plain.argc == 2 && strcmp(plain.argv[0], "$x") == 0 && strcmp(plain.argv[1], "$x") == 0);
+}
+
+static void test_operators(void) {
+	arena_reset(&arena);
+	const char* line = "cat<in>out 2>err|wc & '>' \"2>\" a2>b";
+	size_t used;
+	CHECK(lexer_split(&lexer, line, strlen(line), ALL_OPERATORS, &used) == 0);
+	const char* words[] = {"cat", "<", "in", ">", "out", "2>", "err", "|", "wc", "&", ">", "2>", "a2", ">", "b"};
+	const enum token_kind kinds[] = {TOKEN_WORD, TOKEN_IN, TOKEN_WORD, TOKEN_OUT, TOKEN_WORD, TOKEN_ERR_OUT, TOKEN_WORD,
+		TOKEN_PIPE, TOKEN_WORD, TOKEN_AMP, TOKEN_WORD, TOKEN_WORD, TOKEN_WORD, TOKEN_OUT, TOKEN_WORD};
+	int count = sizeof(words) / sizeof(words[0]);
+	CHECK(lexer.argc == count);
+	for (int i = 0; i < count && i < lexer.argc; i++) {
+		CHECK(strcmp(lexer.argv[i], words[i]) == 0);
+		CHECK(lexer.kinds[i] == kinds[i]);
+	}
+
+	// an operator the shell can't run is an error
+	arena_reset(&arena);
+	line = "ls | wc";
+	CHECK(lexer_split(&lexer, line, strlen(line), TOKEN_MASK(TOKEN_OUT), &used) == LEX_ERROR);
+	arena_reset(&arena);
+	line = "ls '|' wc";
+	CHECK(lexer_split(&lexer, line, strlen(line), 0, &used) == 0 && lexer.argc == 3);
+}
+
+static void test_commands(void) {
+	// ';' ends a command, used says where the next one starts
+	const char* line = "a 'b;c' ; d;;e";
+	size_t len = strlen(line);
+	size_t pos = 0;
+	const char* expected[][3] = {{"a", "b;c", NULL}, {"d", NULL}, {NULL}, {"e", NULL}};
+	for (int i = 0; i < 4; i++) {
+		arena_reset(&arena);
+		size_t used;
+		CHECK(lexer_split(&lexer, line + pos, len - pos, ALL_OPERATORS, &used) == 0);
+		int count = 0;
+		while (expected[i][count] != NULL) {
+			count++;
+		}
+		CHECK(lexer.argc == count);
+		for (int j = 0; j < count && j < lexer.argc; j++) {
+			CHECK(strcmp(lexer.argv[j], expected[i][j]) == 0);
+		}
+		pos += used;
+	}
+	CHECK(pos == len);
+
+	// the line doesn't have to be NUL terminated
+	arena_reset(&arena);
+	size_t used;
+	CHECK(lexer_split(&lexer, "ab cd", 4, ALL_OPERATORS, &used) == 0);
+	CHECK(lexer.argc == 2 && strcmp(lexer.argv[1], "c") == 0 && used == 4);
+}
+
+static void test_errors(void) {
+	const char* lines[] = {"echo 'abc", "echo \"abc", "echo \"a\\\"", "'"};
+	for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+		arena_reset(&arena);
+		size_t used;
+		CHECK(lexer_split(&lexer, lines[i], strlen(lines[i]), ALL_OPERATORS, &used) == LEX_ERROR);
+	}
+}
+
+int main(void) {
+	memset(long_value, 'v', sizeof(long_value));
+	arena_init(&arena);
+	lexer_init(&lexer, &arena, lookup, NULL);
+	test_words();
+	test_expansion();
+	test_operators();
+	test_commands();
+	test_errors();
+	arena_free(&arena);
+	return check_failures != 0;
+}
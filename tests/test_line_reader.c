@@ -0,0 +1,166 @@
+#define _POSIX_C_SOURCE 200809L	// to use mkstemp, fork, lseek
+#include <stdlib.h>	// to use malloc, free, rand, srand, mkstemp
+#include <string.h>	// to use memset, memcmp, memchr
+#include <unistd.h>	// to use write, close, unlink, pipe, fork, lseek, _exit
+#include <sys/wait.h>	// to use waitpid
+
+#include "check.h"	// to use CHECK, SKIP_TEST
+
+// the module itself, for its static find_newline: this file is built once for each of the
+// paths it can take (AVX2, SSE2 and memchr only) with different -m flags
+#include "line_reader.c"
+
+// find_newline against memchr for every start and length around the vector sizes,
+// with the '\n' at every position, none at all, and more than one
+static void test_find_newline(void) {
+	char buf[256];
+	int wrong = 0;
+	for (size_t start = 0; start < 40; start++) {
+		for (size_t len = 0; start + len <= 140; len++) {
+			for (size_t nl = 0; nl <= len; nl++) {
+				memset(buf, 'a', sizeof(buf));
+				if (nl < len) {
+					buf[start + nl] = '\n';
+					if (nl + 5 < len) {
+						buf[start + nl + 5] = '\n';
+					}
+				}
+				// a '\n' right after the end must not be seen
+				buf[start + len] = '\n';
+				const char* expected = memchr(buf + start, '\n', len);
+				size_t want = expected != NULL ? (size_t)(expected - (buf + start)) : len;
+				wrong += find_newline(buf + start, len) != want;
+			}
+		}
+	}
+	CHECK(wrong == 0);
+}
+
+// the whole input, the reader fed from fd and the lines it gives back compared with input
+static void check_lines(int fd, const char* input, size_t input_len) {
+	struct line_reader reader;
+	line_reader_init(&reader, fd);
+	size_t pos = 0;
+	size_t len;
+	char* line;
+	int lines = 0;
+	while ((line = line_reader_next(&reader, &len)) != NULL) {
+		const char* nl = memchr(input + pos, '\n', input_len - pos);
+		size_t want = nl != NULL ? (size_t)(nl - (input + pos)) : input_len - pos;
+		if (len != want || memcmp(line, input + pos, len) != 0 || line[len] != '\0') {
+			fprintf(stderr, "  line %d at %zu: %zu bytes instead of %zu\n", lines, pos, len, want);
+			check_failures++;
+			break;
+		}
+		pos += want + (nl != NULL);
+		lines++;
+	}
+	CHECK(pos == input_len);
+	CHECK(line_reader_next(&reader, &len) == NULL); // stays at the end
+	line_reader_free(&reader);
+}
+
+// through a file: the reads are whole LINE_READ_SIZE blocks, so lines cross them
+static void check_file(const char* input, size_t input_len) {
+	char path[] = "spl_line_reader_XXXXXX";	// in the build directory, gone right away
+	int fd = mkstemp(path);
+	CHECK(fd >= 0);
+	if (fd < 0) {
+		return;
+	}
+	unlink(path);
+	CHECK(write(fd, input, input_len) == (ssize_t)input_len);
+	lseek(fd, 0, SEEK_SET);
+	check_lines(fd, input, input_len);
+	close(fd);
+}
+
+// through a pipe written in small odd pieces: a line arrives in many short reads
+static void check_pipe(const char* input, size_t input_len) {
+	int fds[2];
+	CHECK(pipe(fds) == 0);
+	pid_t pid = fork();
+	if (pid == 0) {
+		close(fds[0]);
+		size_t pos = 0;
+		while (pos < input_len) {
+			size_t count = input_len - pos < 4093 ? input_len - pos : 4093;
+			if (write(fds[1], input + pos, count) != (ssize_t)count) {
+				_exit(1);
+			}
+			pos += count;
+		}
+		_exit(0);
+	}
+	close(fds[1]);
+	check_lines(fds[0], input, input_len);
+	close(fds[0]);
+	int status;
+	waitpid(pid, &status, 0);
+	CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+static void test_inputs(void) {
+	size_t size = 6 * LINE_READ_SIZE;
+	char* input = malloc(size);
+	srand(1);
+
+	// short lines of every length, some of them empty, so '\n' lands on every block offset
+	size_t len = 0;
+	for (int i = 0; len < size - 200; i++) {
+		size_t line_len = rand() % 100;
+		memset(input + len, 'a' + i % 26, line_len);
+		len += line_len;
+		input[len++] = '\n';
+	}
+	check_file(input, len);
+	check_pipe(input, len);
+
+	// the last line has no '\n'
+	check_file(input, len - 1);
+	check_file("a", 1);
+	check_file("", 0);
+	check_file("\n\n\n", 3);
+
+	// lines longer than a block and longer than the buffer, which has to double
+	memset(input, 'x', size);
+	input[LINE_READ_SIZE - 1] = '\n';
+	input[LINE_READ_SIZE] = '\n';
+	input[LINE_READ_SIZE + 1] = '\n';
+	input[5 * LINE_READ_SIZE + 3] = '\n';
+	check_file(input, size);
+	check_pipe(input, size);
+	free(input);
+}
+
+static void test_string(void) {
+	char* argv[] = {"shell", "-c", "echo a\n\nls ; pwd", NULL};
+	struct line_reader reader;
+	CHECK(line_reader_from_args(&reader, 3, argv) == 0);
+	size_t len;
+	char* line = line_reader_next(&reader, &len);
+	CHECK(line != NULL && len == 6 && strcmp(line, "echo a") == 0);
+	line = line_reader_next(&reader, &len);
+	CHECK(line != NULL && len == 0);
+	line = line_reader_next(&reader, &len);
+	CHECK(line != NULL && strcmp(line, "ls ; pwd") == 0);
+	CHECK(line_reader_next(&reader, &len) == NULL);
+	line_reader_free(&reader);
+
+	char* missing[] = {"shell", "-c", NULL};
+	CHECK(line_reader_from_args(&reader, 2, missing) == -1);
+	char* stdin_args[] = {"shell", NULL};
+	CHECK(line_reader_from_args(&reader, 1, stdin_args) == 1);
+}
+
+int main(void) {
+#if defined(__AVX2__)
+	if (!__builtin_cpu_supports("avx2")) {
+		return SKIP_TEST;
+	}
+#endif
+	test_find_newline();
+	test_inputs();
+	test_string();
+	return check_failures != 0;
+}
@@ -0,0 +1,118 @@
+#include <stdlib.h>	// to use rand, srand
+#include <string.h>	// to use strcmp
+
+#include "check.h"	// to use CHECK
+
+// the module itself, for its hash and slots: the deletion is tested on clusters that
+// are built on purpose, which the API alone can't do
+#include "copy_links.c"
+
+#define KEYS  600	// under 3/4 of LINK_MAP_MIN, the map doesn't grow while the clusters are tested
+#define STEPS 200000
+#define MANY  200000	// grows the map many times
+
+// what the map should hold: remaining links of each key, 0 when it isn't in the map
+struct model {
+	dev_t dev;
+	ino_t ino;
+	unsigned int remaining;
+};
+
+static int check_all(struct link_map* map, struct model* keys, int count) {
+	int wrong = 0;
+	for (int i = 0; i < count; i++) {
+		struct link_entry* entry = link_map_find(map, keys[i].dev, keys[i].ino);
+		if (keys[i].remaining == 0) {
+			wrong += entry != NULL;
+			continue;
+		}
+		char path[32];
+		snprintf(path, sizeof(path), "d/%lu", (unsigned long)keys[i].ino);
+		wrong += entry == NULL || entry->remaining != keys[i].remaining || strcmp(link_map_path(map, entry), path) != 0;
+	}
+	return wrong;
+}
+
+// keys whose home slots are the last 3 and the first 3 of the table, so every cluster
+// wraps around its end, and random adds and removals shift entries across it
+static void test_clusters(void) {
+	struct link_map* map = link_map_new();
+	struct model keys[KEYS];
+	int count = 0;
+	for (ino_t ino = 1; count < KEYS; ino++) {
+		size_t home = hash(1, ino) & (LINK_MAP_MIN - 1);
+		if (home >= LINK_MAP_MIN - 3 || home < 3) {
+			keys[count].dev = 1;
+			keys[count].ino = ino;
+			keys[count].remaining = 0;
+			count++;
+		}
+	}
+
+	srand(1);
+	int wrong = 0;
+	for (int step = 0; step < STEPS && wrong == 0; step++) {
+		struct model* key = &keys[rand() % KEYS];
+		if (key->remaining == 0) {
+			char path[32];
+			snprintf(path, sizeof(path), "d/%lu", (unsigned long)key->ino);
+			nlink_t nlink = 2 + rand() % 3;
+			wrong += link_map_add(map, key->dev, key->ino, nlink, path) == NULL;
+			key->remaining = nlink - 1;
+		}
+		else {
+			struct link_entry* entry = link_map_find(map, key->dev, key->ino);
+			wrong += entry == NULL;
+			if (entry != NULL) {
+				link_map_seen(map, entry);
+			}
+			key->remaining--;
+		}
+		if (step % 97 == 0) {
+			wrong += check_all(map, keys, KEYS);
+		}
+	}
+	wrong += check_all(map, keys, KEYS);
+	CHECK(wrong == 0);
+	CHECK(map->size == LINK_MAP_MIN);
+	link_map_free(map);
+}
+
+// many inodes of two links: the map grows, and once every second link was seen it is empty
+static void test_many(void) {
+	struct link_map* map = link_map_new();
+	int wrong = 0;
+	for (ino_t ino = 0; ino < MANY; ino++) {
+		char path[32];
+		snprintf(path, sizeof(path), "d/%lu", (unsigned long)ino);
+		// a zero (dev, ino) is a key like any other
+		wrong += link_map_add(map, ino % 3, ino, 2, path) == NULL;
+	}
+	for (ino_t ino = 0; ino < MANY; ino++) {
+		char path[32];
+		snprintf(path, sizeof(path), "d/%lu", (unsigned long)ino);
+		struct link_entry* entry = link_map_find(map, ino % 3, ino);
+		wrong += entry == NULL || entry->remaining != 1 || strcmp(link_map_path(map, entry), path) != 0;
+		wrong += link_map_find(map, ino % 3 + 1, ino) != NULL;
+	}
+	CHECK(wrong == 0);
+	for (ino_t ino = 0; ino < MANY; ino += 2) {
+		link_map_seen(map, link_map_find(map, ino % 3, ino));
+	}
+	for (ino_t ino = 0; ino < MANY; ino++) {
+		wrong += (link_map_find(map, ino % 3, ino) == NULL) != (ino % 2 == 0);
+	}
+	for (ino_t ino = 1; ino < MANY; ino += 2) {
+		link_map_seen(map, link_map_find(map, ino % 3, ino));
+	}
+	CHECK(wrong == 0);
+	CHECK(map->count == 0);
+	CHECK(map->pool_len == 0);	// nothing points into the pool anymore, it starts over
+	link_map_free(map);
+}
+
+int main(void) {
+	test_clusters();
+	test_many();
+	return check_failures != 0;
+}
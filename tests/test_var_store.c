@@ -0,0 +1,93 @@
+#define _POSIX_C_SOURCE 200809L	// to use unsetenv
+#include <stdlib.h>	// to use getenv, unsetenv
+#include <string.h>	// to use strlen, strcmp, memcmp
+
+#include "check.h"	// to use CHECK
+#include "var_store.h"	// to use var_store_new, var_store_get, var_store_set, var_store_export, var_store_free
+
+#define MANY 100000	// enough to grow the table many times over its 64 first slots
+
+static int has_value(struct var_store* store, const char* key, const char* value) {
+	size_t value_len;
+	const char* found = var_store_get(store, key, strlen(key), &value_len);
+	return found != NULL && value_len == strlen(value) && memcmp(found, value, value_len) == 0;
+}
+
+static int set(struct var_store* store, const char* key, const char* value) {
+	return var_store_set(store, key, strlen(key), value, strlen(value));
+}
+
+static void test_set_get(void) {
+	struct var_store* store = var_store_new();
+	CHECK(store != NULL);
+	size_t value_len;
+	CHECK(var_store_get(store, "x", 1, &value_len) == NULL);
+
+	CHECK(set(store, "x", "1") == 0);
+	CHECK(has_value(store, "x", "1"));
+	// in place: shorter, longer, empty, then back
+	CHECK(set(store, "x", "") == 0);
+	CHECK(has_value(store, "x", ""));
+	CHECK(set(store, "x", "a much longer value than before") == 0);
+	CHECK(has_value(store, "x", "a much longer value than before"));
+	CHECK(set(store, "x", "2") == 0);
+	CHECK(has_value(store, "x", "2"));
+
+	// keys are compared by length too, not as prefixes
+	CHECK(set(store, "xy", "3") == 0);
+	CHECK(has_value(store, "x", "2") && has_value(store, "xy", "3"));
+	CHECK(var_store_get(store, "xyz", 2, &value_len) != NULL && value_len == 1);
+	CHECK(var_store_get(store, "xyz", 3, &value_len) == NULL);
+	CHECK(var_store_get(store, "", 0, &value_len) == NULL);
+	var_store_free(store);
+}
+
+static void test_many(void) {
+	struct var_store* store = var_store_new();
+	char key[32];
+	char value[32];
+	for (int i = 0; i < MANY; i++) {
+		snprintf(key, sizeof(key), "k%d", i);
+		snprintf(value, sizeof(value), "%d", i * 7);
+		CHECK(set(store, key, value) == 0);
+	}
+	// every one survived the growths, and an update of half of them touches only those
+	for (int i = 0; i < MANY; i += 2) {
+		snprintf(key, sizeof(key), "k%d", i);
+		CHECK(set(store, key, "even") == 0);
+	}
+	int wrong = 0;
+	for (int i = 0; i < MANY; i++) {
+		snprintf(key, sizeof(key), "k%d", i);
+		snprintf(value, sizeof(value), "%d", i * 7);
+		wrong += !has_value(store, key, i % 2 == 0 ? "even" : value);
+	}
+	CHECK(wrong == 0);
+	size_t value_len;
+	CHECK(var_store_get(store, "k100000", 7, &value_len) == NULL);
+	var_store_free(store);
+}
+
+static void test_export(void) {
+	struct var_store* store = var_store_new();
+	unsetenv("SPL_TEST_VAR");
+	// exporting a variable that isn't set does nothing
+	CHECK(var_store_export(store, "SPL_TEST_VAR") == 0);
+	CHECK(getenv("SPL_TEST_VAR") == NULL);
+
+	CHECK(set(store, "SPL_TEST_VAR", "one") == 0);
+	CHECK(getenv("SPL_TEST_VAR") == NULL);
+	CHECK(var_store_export(store, "SPL_TEST_VAR") == 0);
+	CHECK(getenv("SPL_TEST_VAR") != NULL && strcmp(getenv("SPL_TEST_VAR"), "one") == 0);
+	// once exported, later assignments reach the environment too
+	CHECK(set(store, "SPL_TEST_VAR", "two") == 0);
+	CHECK(getenv("SPL_TEST_VAR") != NULL && strcmp(getenv("SPL_TEST_VAR"), "two") == 0);
+	var_store_free(store);
+}
+
+int main(void) {
+	test_set_get();
+	test_many();
+	test_export();
+	return check_failures != 0;
+}